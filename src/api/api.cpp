@@ -1,5 +1,10 @@
 #include "api.h"
 #include "../materials/blinn_phong.h"
+#include "../materials/material_table.h"
+#include "../core/parallel.h"
+#include "../core/stats.h"
+
+#include <mutex>
 
 namespace rt3 {
 
@@ -59,7 +64,18 @@ void API::world_end(void) {
   // already been parsed. It's time to render the scene.
 
   unique_ptr<Scene> the_scene;
-  unique_ptr<Integrator> the_integrator;
+
+  // Distributed render: the workers load the scene on their own, meanwhile.
+  vector<unique_ptr<Connection>> workers;
+  if (curr_run_opt.spawn_workers > 0) {
+    int threads = max(1, resolve_thread_count(curr_run_opt.nthreads) / curr_run_opt.spawn_workers);
+    workers = spawn_workers(curr_run_opt.spawn_workers, threads, curr_run_opt);
+  }
+  for (const string &address : curr_run_opt.workers) {
+    if (auto worker = connect_worker(address))
+      workers.push_back(std::move(worker));
+  }
+  const bool is_worker = curr_run_opt.worker_fd >= 0 || curr_run_opt.worker_port > 0;
 
   // LOADING SCENE
   {
@@ -69,6 +85,9 @@ void API::world_end(void) {
 
     Bounds3f worldBox;
 
+    // Materials are copied once into a flat table; primitives keep their index.
+    shared_ptr<MaterialTable> the_materials = make_shared<MaterialTable>();
+
     vector<shared_ptr<BoundedPrimitive>> the_primitive;
     for (auto [object_ps, mat, transform] : objM.globalPrimitives) {
 
@@ -76,12 +95,14 @@ void API::world_end(void) {
 
       worldBox = Bounds3f::unite(worldBox, shape->computeBounds());
 
-      the_primitive.push_back(shared_ptr<BoundedPrimitive>(
-          make_geometric_primitive(std::move(shape), mat)));
+      GeometricPrimitive *prim = make_geometric_primitive(std::move(shape), the_materials->add(mat));
+      prim->id = int(the_primitive.size());
+      the_primitive.push_back(shared_ptr<BoundedPrimitive>(prim));
     }
 
     // TRIANGLES MESHES
     for (auto [mesh_ps, mat, transform] : objM.globalMeshPrimitives) {
+      int material_id = the_materials->add(mat);
 
       // criar mesh nova e aplicar transforms
       shared_ptr<TriangleMesh> newMesh = mesh_ps->createCopy();
@@ -91,9 +112,9 @@ void API::world_end(void) {
 
         worldBox = Bounds3f::unite(worldBox, s->computeBounds());
 
-        the_primitive.push_back(shared_ptr<BoundedPrimitive>(
-          make_geometric_primitive(std::move(unique_ptr<Shape>(s)), mat)
-        ));
+        GeometricPrimitive *prim = make_geometric_primitive(std::move(unique_ptr<Shape>(s)), material_id);
+        prim->id = int(the_primitive.size());
+        the_primitive.push_back(shared_ptr<BoundedPrimitive>(prim));
 
       }
     }
@@ -104,41 +125,47 @@ void API::world_end(void) {
     vector<shared_ptr<Light>> the_lights;
     for (auto light_ps : objM.globalLights) {
       the_lights.push_back(shared_ptr<Light>(make_light(light_ps, worldBox)));
+
+      string light_name = light_type_t_names[int(retrieve(light_ps, "type", light_type_t::ambient))];
+      the_lights.back()->shadowRaysAvoided = &stat_counter(
+          "Shadow rays avoided", "light " + std::to_string(the_lights.size() - 1) + " (" + light_name + ")");
     }
 
     the_scene =
-        make_unique<Scene>(std::move(the_background), std::move(primitive), std::move(the_lights));
+        make_unique<Scene>(std::move(the_background), std::move(primitive), std::move(the_lights),
+                           std::move(the_materials));
   }
 
-  // LOADING INTEGRATOR
-  {
-    unique_ptr<Film> the_film{make_film(render_opt->film_ps)};
-
-    // Same with the camera
-    unique_ptr<Camera> the_camera{make_camera(
-        render_opt->camera_ps, render_opt->look_at_ps, std::move(the_film))};
-
-    // Integrator
-    the_integrator = unique_ptr<Integrator>(
-        make_integrator(render_opt->integrator_ps, std::move(the_camera)));
-  }
-
-  // Run only if we got film and background.
-  if (the_integrator and the_scene) {
+  // Run only if we got the scene.
+  if (the_scene) {
     RT3_MESSAGE("\tParsing scene successfuly done!\n");
     RT3_MESSAGE("[2] Starting ray tracing progress.\n");
 
-    // Structure biding, c++17.
-    // auto res  = the_integrator->camera->film->get_resolution();
-    // size_t w = res[0];
-    // size_t h = res[1];
-    // RT3_MESSAGE( "    Image dimensions in pixels (W x H): " +
-    // std::to_string(w) + " x " + std::to_string(h) + ".\n" ); RT3_MESSAGE( "
-    // Ray tracing is usually a slow process, please be patient: \n" );
-
     //================================================================================
+    reset_render_stats();
     auto start = std::chrono::steady_clock::now();
-    the_integrator->render(the_scene);
+    if (render_opt->animation_ps.empty()) {
+      unique_ptr<Integrator> the_integrator{
+          make_frame_integrator(render_opt->look_at_ps, -1)};
+      the_integrator->set_threads(resolve_thread_count(curr_run_opt.nthreads));
+      if (is_worker) {
+        unique_ptr<Connection> coordinator =
+            curr_run_opt.worker_fd >= 0 ? make_unique<Connection>(curr_run_opt.worker_fd, "coordinator")
+                                        : accept_coordinator(curr_run_opt.worker_port);
+        the_integrator->set_progress_bar(false);
+        the_integrator->serve(the_scene, *coordinator);
+      } else {
+        the_integrator->set_workers(std::move(workers));
+        the_integrator->render(the_scene);
+      }
+    } else {
+      if (is_worker)
+        RT3_ERROR("Animations cannot be rendered by workers.");
+      if (!workers.empty())
+        RT3_WARNING("Animations are rendered here only; not using the workers.");
+      workers.clear();
+      render_animation(the_scene);
+    }
     auto end = std::chrono::steady_clock::now();
     //================================================================================
     auto diff = end - start; // Store the time difference between start and end
@@ -149,12 +176,58 @@ void API::world_end(void) {
                 std::to_string(
                     std::chrono::duration<double, std::milli>(diff).count()) +
                 " ms) \n");
+    report_render_stats();
   }
   // [4] Basic clean up
   curr_state = APIState::SetupBlock; // correct machine state.
   clean_world_elements();
 }
 
+Integrator *API::make_frame_integrator(const ParamSet &ps_look_at, int frame) {
+  unique_ptr<Film> the_film{make_film(render_opt->film_ps)};
+  if (frame >= 0)
+    the_film->m_filename = numbered_filename(the_film->m_filename, frame);
+
+  // Same with the camera
+  unique_ptr<Camera> the_camera{make_camera(
+      render_opt->camera_ps, ps_look_at, std::move(the_film))};
+
+  // Integrator
+  return make_integrator(render_opt->integrator_ps, std::move(the_camera));
+}
+
+void API::render_animation(const unique_ptr<Scene> &scene) {
+  unique_ptr<CameraPath> path{create_camera_path(
+      render_opt->animation_ps, render_opt->keyframes_ps, render_opt->look_at_ps)};
+
+  // The thread budget is split between frames and tiles: `frame_threads`
+  // frames are in flight at once, each one using the remaining threads.
+  int total_threads = resolve_thread_count(curr_run_opt.nthreads);
+  int frame_threads = min(path->frame_threads, path->n_frames);
+  int tile_threads = max(1, total_threads / frame_threads);
+
+  RT3_MESSAGE("    Rendering " + std::to_string(path->n_frames) + " frames (" +
+              std::to_string(frame_threads) + " at a time, " +
+              std::to_string(tile_threads) + " threads each).\n");
+
+  std::mutex setup_mutex;
+  parallel_for(path->n_frames, frame_threads, [&](int frame, int /* worker */) {
+    unique_ptr<Integrator> frame_integrator;
+    {
+      // The factories share the render options (and log a lot), so frames
+      // are set up one at a time; only the rendering itself overlaps.
+      std::lock_guard<std::mutex> lock(setup_mutex);
+      frame_integrator.reset(make_frame_integrator(path->lookat_ps(frame), frame));
+    }
+    frame_integrator->set_threads(tile_threads);
+    frame_integrator->set_progress_bar(frame_threads == 1);
+    frame_integrator->render(scene);
+
+    RT3_MESSAGE("    Frame " + std::to_string(frame + 1) + "/" +
+                std::to_string(path->n_frames) + " done.");
+  });
+}
+
 /// This api function is called when we need to re-render the *same* scene (i.e.
 /// objects, lights, materials, etc) , maybe with different integrator, and
 /// camera setup. Hard reset on the engine. User needs to setup all entities,
@@ -197,6 +270,25 @@ void API::lookat(const ParamSet &ps) {
   render_opt->look_at_ps = ps;
 }
 
+void API::animation(const ParamSet &ps) {
+  std::cout << ">>> Inside API::animation()\n";
+  VERIFY_SETUP_BLOCK("API::animation");
+
+  // A new animation starts a new camera path.
+  render_opt->animation_ps = ps;
+  render_opt->keyframes_ps.clear();
+}
+
+void API::keyframe(const ParamSet &ps) {
+  std::cout << ">>> Inside API::keyframe()\n";
+  VERIFY_SETUP_BLOCK("API::keyframe");
+
+  if (render_opt->animation_ps.empty())
+    RT3_ERROR("A `keyframe` must come after the `animation` tag.");
+
+  render_opt->keyframes_ps.push_back(ps);
+}
+
 void API::accelerator(const ParamSet &ps) {
   std::cout << ">>> Inside API::accelerator()\n";
   VERIFY_SETUP_BLOCK("API::accelerator");
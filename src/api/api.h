@@ -6,6 +6,7 @@
 #include "../core/rt3-base.h"
 #include "../core/primitive.h"
 #include "../core/transform.h"
+#include "../core/animation.h"
 #include "object_manager.h"
 #include "graphics_managers.h"
 
@@ -60,6 +61,10 @@ namespace rt3 {
         /// the Look At
         ParamSet look_at_ps;
 
+        /// the (optional) camera animation and its keyframes
+        ParamSet animation_ps;
+        vector<ParamSet> keyframes_ps;
+
         /// the integrator
         ParamSet integrator_ps;
         
@@ -117,6 +122,10 @@ namespace rt3 {
 
             static Integrator * make_integrator( const ParamSet& ps, unique_ptr<Camera> &&camera );
 
+            static Sampler * make_sampler( const ParamSet& ps_integrator );
+
+            static Filter * make_filter( const ParamSet& ps_film );
+
             static Background * make_background( const ParamSet& ps );
 
             static Material * make_material( const ParamSet& ps );
@@ -127,7 +136,7 @@ namespace rt3 {
             static Light * make_light( const ParamSet& ps, Bounds3f worldBox );
 
             static GeometricPrimitive * make_geometric_primitive( 
-                unique_ptr<Shape> &&shape, shared_ptr<Material> material );
+                unique_ptr<Shape> &&shape, int material_id );
 
             static Camera * make_camera( const ParamSet& ps_camera, 
                 const ParamSet& ps_look_at, unique_ptr<Film>&& the_film );
@@ -135,6 +144,12 @@ namespace rt3 {
             static shared_ptr<Primitive> make_primitive( const ParamSet& ps_accelerator, 
                 vector<shared_ptr<BoundedPrimitive>>&& primitives);
 
+            /// Film + camera + integrator for one frame; `frame` < 0 keeps the film's file name untouched.
+            static Integrator * make_frame_integrator( const ParamSet& ps_look_at, int frame );
+
+            /// Renders every frame of the camera animation over the (already built) scene.
+            static void render_animation( const unique_ptr<Scene>& scene );
+
         public:
             //=== API function begins here.
             static void init_engine( const RunningOptions& );
@@ -148,6 +163,8 @@ namespace rt3 {
             static void lookat( const ParamSet& ps );
             static void camera( const ParamSet& ps );
             static void background( const ParamSet& ps );
+            static void animation( const ParamSet& ps );
+            static void keyframe( const ParamSet& ps );
 
             static void accelerator( const ParamSet& ps );
 
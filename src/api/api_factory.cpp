@@ -17,6 +17,7 @@
 
 #include "../shapes/sphere.h"
 #include "../shapes/triangle.h"
+#include "../core/parser.h"
 
 namespace rt3 {
 
@@ -25,6 +26,7 @@ Film * API::make_film( const ParamSet &ps )
     std::cout << ">>> Inside API::make_film()\n";
     Film *film{ nullptr };
     film = create_film( ps );
+    film->set_filter( unique_ptr<Filter>( make_filter( ps ) ) );
 
     // Return the newly created film.
     return film;
@@ -85,12 +87,80 @@ Integrator * API::make_integrator( const ParamSet &ps_integrator,
     }else{
         RT3_ERROR("Integrator type unknown.");
     }
+
+    integ->set_packets(retrieve(ps_integrator, "packets", true));
+    integ->set_sampler(unique_ptr<Sampler>(make_sampler(ps_integrator)));
+    integ->set_adaptive(retrieve(ps_integrator, "adaptive_threshold", real_type(0)),
+                        retrieve(ps_integrator, "min_spp", int(4)));
+    integ->set_sample_map(retrieve(ps_integrator, "sample_map", string()));
+    integ->set_progressive(curr_run_opt.progressive, curr_run_opt.time_budget, curr_run_opt.flush_interval);
+    integ->set_checkpoint(curr_run_opt.checkpoint_interval, curr_run_opt.resume);
+    integ->set_scene_id(scene_files_hash());
     
     // Return the newly created integrator
     return integ;
 }
 
 
+Sampler * API::make_sampler( const ParamSet &ps_integrator )
+{
+    std::cout << ">>> Inside API::make_sampler()\n";
+    int spp = retrieve(ps_integrator, "spp", int(1));
+    if(spp < 1) RT3_ERROR("The number of samples per pixel (spp) must be at least 1.");
+
+    // A single sample per pixel stays at the pixel center unless asked otherwise.
+    sampler_type_t type = retrieve(ps_integrator, "sampler",
+        spp == 1 ? sampler_type_t::center : sampler_type_t::stratified);
+
+    Sampler *sampler = nullptr;
+    if(type == sampler_type_t::center){
+        sampler = new CenterSampler(spp);
+    }else if(type == sampler_type_t::stratified){
+        sampler = new StratifiedSampler(spp);
+    }else if(type == sampler_type_t::halton){
+        sampler = new HaltonSampler(spp);
+    }else if(type == sampler_type_t::sobol){
+        sampler = new SobolSampler(spp);
+    }else{
+        RT3_ERROR("Sampler type unknown.");
+    }
+
+    return sampler;
+}
+
+
+Filter * API::make_filter( const ParamSet &ps_film )
+{
+    filter_type_t type = retrieve(ps_film, "filter", filter_type_t::none);
+    if(type == filter_type_t::none) return nullptr;
+
+    std::cout << ">>> Inside API::make_filter()\n";
+    // Default radii (in pixels) as in pbrt.
+    real_type radius;
+    if(type == filter_type_t::box) radius = retrieve(ps_film, "filter_radius", real_type(0.5));
+    else if(type == filter_type_t::tent) radius = retrieve(ps_film, "filter_radius", real_type(2));
+    else if(type == filter_type_t::gaussian) radius = retrieve(ps_film, "filter_radius", real_type(1.5));
+    else radius = retrieve(ps_film, "filter_radius", real_type(2));
+    if(radius <= 0) RT3_ERROR("The filter radius must be positive.");
+
+    Filter *filter = nullptr;
+    if(type == filter_type_t::box){
+        filter = new BoxFilter(radius);
+    }else if(type == filter_type_t::tent){
+        filter = new TriangleFilter(radius);
+    }else if(type == filter_type_t::gaussian){
+        filter = new GaussianFilter(radius, retrieve(ps_film, "filter_alpha", real_type(2)));
+    }else if(type == filter_type_t::mitchell){
+        filter = new MitchellFilter(radius, retrieve(ps_film, "mitchell_b", real_type(1) / 3),
+                                            retrieve(ps_film, "mitchell_c", real_type(1) / 3));
+    }else{
+        RT3_ERROR("Filter type unknown.");
+    }
+
+    return filter;
+}
+
+
 Light * API::make_light( const ParamSet &ps_light, Bounds3f worldBox )
 {
     std::cout << ">>> Inside API::make_light()\n";
@@ -134,12 +204,12 @@ Material * API::make_material( const ParamSet &ps_material)
 
 
 GeometricPrimitive * API::make_geometric_primitive( 
-        unique_ptr<Shape> &&shape, shared_ptr<Material> material ){
+        unique_ptr<Shape> &&shape, int material_id ){
 
     std::cout << ">>> Inside API::make_primitive()\n";
 
     return new GeometricPrimitive(
-        material,
+        material_id,
         std::move(shape)
     );
 }
@@ -1,8 +1,8 @@
 #include "orthographic.h"
 
 namespace rt3{
-Ray OrthographicCamera::generate_ray(int i, int j){
-    auto [u_, v_] = get_uv_pos(i, j);
+Ray OrthographicCamera::generate_ray(const Point2f &film_pos){
+    auto [u_, v_] = get_uv_pos(film_pos);
     Point3f origin = eye + (u * u_) + (v * v_);
     return Ray(origin, w);
 }
@@ -10,7 +10,8 @@ public:
     OrthographicCamera(unique_ptr<Film> &&_film, Point3f _eye, Point3f _center, Vector3f _up, ScreenWindow sw);
     ~OrthographicCamera();
     
-    Ray generate_ray(int x, int y);
+    using Camera::generate_ray;
+    Ray generate_ray(const Point2f &film_pos) override;
 };
 
 
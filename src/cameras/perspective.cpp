@@ -46,8 +46,8 @@ PerspectiveCamera* create_perspective_camera(
     return camera;
 }
 
-Ray PerspectiveCamera::generate_ray(int i, int j){
-    auto [u_, v_] = get_uv_pos(i, j);
+Ray PerspectiveCamera::generate_ray(const Point2f &film_pos){
+    auto [u_, v_] = get_uv_pos(film_pos);
     Vector3f direction = w + (u * u_) + (v * v_);
     return Ray(eye, direction);
 }
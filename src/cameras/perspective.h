@@ -10,7 +10,8 @@ public:
     PerspectiveCamera(unique_ptr<Film> &&_film, Point3f _eye, Point3f _center, Vector3f _up, ScreenWindow sw);
     ~PerspectiveCamera();
     
-    Ray generate_ray(int x, int y);
+    using Camera::generate_ray;
+    Ray generate_ray(const Point2f &film_pos) override;
 };
 
 PerspectiveCamera* create_perspective_camera(
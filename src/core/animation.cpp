@@ -0,0 +1,112 @@
+#include "animation.h"
+
+#include <iomanip>
+#include <sstream>
+
+namespace rt3{
+
+namespace{
+
+/// Catmull-Rom spline through p1 (t=0) and p2 (t=1), with p0 and p3 as tangent guides.
+real_type catmull_rom(real_type p0, real_type p1, real_type p2, real_type p3, real_type t){
+    real_type t2 = t * t, t3 = t2 * t;
+    return 0.5f * ((2 * p1) + (p2 - p0) * t +
+                   (2 * p0 - 5 * p1 + 4 * p2 - p3) * t2 +
+                   (3 * p1 - p0 - 3 * p2 + p3) * t3);
+}
+
+template <typename T>
+T interpolate(interpolation_type_t type, const T &p0, const T &p1, const T &p2, const T &p3, real_type t){
+    T result;
+    for(int i = 0; i < 3; ++i){
+        if(type == interpolation_type_t::catmull_rom){
+            result[i] = catmull_rom(p0.at(i), p1.at(i), p2.at(i), p3.at(i), t);
+        }else{
+            result[i] = Lerp(t, p1.at(i), p2.at(i));
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+CameraPath::CameraPath(vector<CameraKeyframe> &&keyframes, interpolation_type_t interp, int frames, int fthreads):
+    keys(std::move(keyframes)), interpolation(interp), n_frames(frames), frame_threads(fthreads){
+    std::stable_sort(keys.begin(), keys.end(), [](const CameraKeyframe &a, const CameraKeyframe &b){
+        return a.frame < b.frame;
+    });
+}
+
+CameraKeyframe CameraPath::pose(int frame) const{
+    // Before the first / after the last keyframe the camera stays still.
+    if(frame <= keys.front().frame) return keys.front();
+    if(frame >= keys.back().frame) return keys.back();
+
+    // keys[k] is the last keyframe at or before `frame`.
+    size_t k = 0;
+    while(keys[k + 1].frame <= frame) ++k;
+
+    const CameraKeyframe &k0 = keys[k == 0 ? 0 : k - 1];
+    const CameraKeyframe &k1 = keys[k];
+    const CameraKeyframe &k2 = keys[k + 1];
+    const CameraKeyframe &k3 = keys[min(k + 2, keys.size() - 1)];
+
+    real_type t = real_type(frame - k1.frame) / real_type(k2.frame - k1.frame);
+
+    CameraKeyframe result;
+    result.frame = frame;
+    result.look_from = interpolate(interpolation, k0.look_from, k1.look_from, k2.look_from, k3.look_from, t);
+    result.look_at = interpolate(interpolation, k0.look_at, k1.look_at, k2.look_at, k3.look_at, t);
+    result.up = interpolate(interpolation, k0.up, k1.up, k2.up, k3.up, t).normalize();
+    return result;
+}
+
+ParamSet CameraPath::lookat_ps(int frame) const{
+    CameraKeyframe key = pose(frame);
+
+    ParamSet ps;
+    ps["look_from"] = make_shared<Value<Point3f>>(key.look_from);
+    ps["look_at"] = make_shared<Value<Point3f>>(key.look_at);
+    ps["up"] = make_shared<Value<Vector3f>>(key.up);
+    return ps;
+}
+
+string numbered_filename(const string &filename, int frame){
+    std::ostringstream number;
+    number << "_" << std::setw(4) << std::setfill('0') << frame;
+
+    return insert_before_extension(filename, number.str());
+}
+
+CameraPath *create_camera_path(const ParamSet &anim_ps, const vector<ParamSet> &keyframes_ps,
+                               const ParamSet &look_at_ps){
+    int frames = retrieve(anim_ps, "frames", int(1));
+    if(frames < 1) RT3_ERROR("Animation must have at least one frame.");
+
+    vector<CameraKeyframe> keys;
+    for(const auto &ps : keyframes_ps){
+        keys.push_back(CameraKeyframe{
+            retrieve(ps, "frame", int(0)),
+            retrieve(ps, "look_from", Point3f({0.0, 0.1, 0.0})),
+            retrieve(ps, "look_at", Point3f({0.0, 0.1, 0.0})),
+            retrieve(ps, "up", Vector3f({0.0, 0.1, 0.0}))
+        });
+    }
+    if(keys.empty()){
+        keys.push_back(CameraKeyframe{
+            0,
+            retrieve(look_at_ps, "look_from", Point3f({0.0, 0.1, 0.0})),
+            retrieve(look_at_ps, "look_at", Point3f({0.0, 0.1, 0.0})),
+            retrieve(look_at_ps, "up", Vector3f({0.0, 0.1, 0.0}))
+        });
+    }
+
+    return new CameraPath(
+        std::move(keys),
+        retrieve(anim_ps, "interpolation", interpolation_type_t::linear),
+        frames,
+        max(1, retrieve(anim_ps, "frame_threads", int(1)))
+    );
+}
+
+} // namespace rt3
@@ -0,0 +1,49 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include "rt3.h"
+#include "paramset.h"
+
+namespace rt3{
+
+/// A camera pose (a `lookat`) pinned to a given frame of the animation.
+struct CameraKeyframe{
+    int frame;
+    Point3f look_from, look_at;
+    Vector3f up;
+};
+
+/*!
+ * Keyframed camera animation.
+ * The camera pose of any frame is obtained by interpolating the two keyframes
+ * surrounding it (linearly or with a Catmull-Rom spline), so a whole turntable
+ * can be described with a handful of `keyframe` tags.
+ */
+class CameraPath{
+private:
+    vector<CameraKeyframe> keys; //!< Sorted by frame.
+    interpolation_type_t interpolation;
+
+public:
+    const int n_frames;    //!< Number of frames to render.
+    const int frame_threads; //!< How many frames are rendered at the same time.
+
+    CameraPath(vector<CameraKeyframe> &&keyframes, interpolation_type_t interp, int frames, int fthreads);
+
+    /// Interpolated camera pose at `frame`.
+    CameraKeyframe pose(int frame) const;
+    /// Same as pose(), but packed as the ParamSet a `lookat` tag produces.
+    ParamSet lookat_ps(int frame) const;
+};
+
+/// Returns `filename` with the frame number inserted before the extension: image.png -> image_0007.png
+string numbered_filename(const string &filename, int frame);
+
+/// Factory: `anim_ps` comes from the `animation` tag, `keyframes_ps` from the `keyframe` tags.
+/// When no keyframe is given, the static `look_at_ps` is used for every frame.
+CameraPath *create_camera_path(const ParamSet &anim_ps, const vector<ParamSet> &keyframes_ps,
+                               const ParamSet &look_at_ps);
+
+} // namespace rt3
+
+#endif
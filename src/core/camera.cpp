@@ -2,11 +2,11 @@
 
 namespace rt3{
 
-pair<real_type, real_type> Camera::get_uv_pos(int i, int j){
-    real_type u_pos = sw.width() * (j + 0.5);
+pair<real_type, real_type> Camera::get_uv_pos(const Point2f &film_pos){
+    real_type u_pos = sw.width() * film_pos.at(1);
     u_pos /= film->width(); u_pos += sw.left;
 
-    real_type v_pos = sw.height() * (i + 0.5);
+    real_type v_pos = sw.height() * film_pos.at(0);
     v_pos /= film->height(); v_pos += sw.bottom;
 
     return {u_pos, v_pos};
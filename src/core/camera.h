@@ -16,9 +16,13 @@ public:
 
     Camera(unique_ptr<Film> &&film, Point3f eye, Point3f center, Vector3f up, ScreenWindow sw);
     
-    pair<real_type, real_type> get_uv_pos(int i, int j);
+    /// Screen space position of a film position (row, column), given in pixels: pixel (i, j) covers [i, i+1) x [j, j+1).
+    pair<real_type, real_type> get_uv_pos(const Point2f &film_pos);
 
-    virtual Ray generate_ray(int x, int y) = 0;
+    /// Ray through a film position (row, column), in pixels.
+    virtual Ray generate_ray(const Point2f &film_pos) = 0;
+    /// Ray through the center of pixel (i, j).
+    Ray generate_ray(int i, int j){ return generate_ray(Point2f{{i + real_type(0.5), j + real_type(0.5)}}); }
     // virtual ~Camera() = 0;
 };
 
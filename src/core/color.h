@@ -12,20 +12,30 @@ public:
 
   Color(const vector<real_type> &v):StructuredValues<real_type, 3>(v){}
 
-  Color clamp(){
+  Color(std::initializer_list<real_type> v):StructuredValues<real_type, 3>(v){}
+
+  Color clamp() const{
     Color newColor(*this);
-    for(auto &x : newColor.values){
-      x = Clamp<real_type, real_type, real_type>(x, 0, 1);
+    if constexpr (simd_layout<real_type, 3>){
+      // Clamp() of each channel: max, then min, each keeping a NaN as it is.
+      newColor.set_lanes(min(max(lanes(), Float4::broadcast(0)), Float4::broadcast(1)));
+    }else{
+      for(int i = 0; i < 3; ++i){
+        newColor.values[i] = Clamp<real_type, real_type, real_type>(values[i], 0, 1);
+      }
     }
     return newColor;
   }
 
-  static inline Color interpolate_color(const float t, const Color &a, const Color &b){
-    return Color{{
-      (real_type) Lerp(t, a.x(), b.x()),
-      (real_type) Lerp(t, a.y(), b.y()),
-      (real_type) Lerp(t, a.z(), b.z()),
-    }};
+  static inline Color interpolate_color(const real_type t, const Color &a, const Color &b){
+    Color c;
+    if constexpr (simd_layout<real_type, 3>){
+      // Lerp() of each channel.
+      c.set_lanes(Float4::broadcast(1 - t) * a.lanes() + Float4::broadcast(t) * b.lanes());
+    }else{
+      for(int i = 0; i < 3; ++i) c[i] = Lerp(t, a.at(i), b.at(i));
+    }
+    return c;
   }
 
   static inline Color make_color_from_real(const vector<real_type> &v){
@@ -38,11 +48,27 @@ public:
   }
 };
 
-Color operator+(const Color &x, const Color &y);
+/// Channel-wise. Radiance is not bounded: clamp() where a value must lie in [0, 1].
+inline Color operator+(const Color &x, const Color &y){
+    Color v;
+    if constexpr (simd_layout<real_type, 3>) v.set_lanes(x.lanes() + y.lanes());
+    else for(int i = 0; i < 3; ++i) v[i] = x.at(i) + y.at(i);
+    return v;
+}
 
-Color operator*(const Color &x, const Color &y);
+inline Color operator*(const Color &x, const Color &y){
+    Color v;
+    if constexpr (simd_layout<real_type, 3>) v.set_lanes(x.lanes() * y.lanes());
+    else for(int i = 0; i < 3; ++i) v[i] = x.at(i) * y.at(i);
+    return v;
+}
 
-Color operator*(const Color &x, real_type y);
+inline Color operator*(const Color &x, real_type y){
+    Color v;
+    if constexpr (simd_layout<real_type, 3>) v.set_lanes(x.lanes() * Float4::broadcast(y));
+    else for(int i = 0; i < 3; ++i) v[i] = x.at(i) * y;
+    return v;
+}
 
 const Color BLACK = Color({0, 0, 0});
 
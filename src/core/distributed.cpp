@@ -0,0 +1,178 @@
+#include "distributed.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace rt3{
+
+namespace{
+
+/// Tiles go back and forth in small messages; don't let Nagle hold them back.
+void set_no_delay(int fd){
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+/// Shortest text that reads back as the same real (for the command line of a worker).
+string real_arg(real_type x){
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.9g", double(x));
+    return buffer;
+}
+
+} // namespace
+
+Connection::~Connection(){
+    close(fd);
+    if(child > 0) waitpid(child, nullptr, 0);
+}
+
+bool Connection::send(const void *data, size_t size){
+    const char *bytes = static_cast<const char*>(data);
+    while(size > 0){
+        // MSG_NOSIGNAL: a worker that went away is reported, not a SIGPIPE.
+        ssize_t n = ::send(fd, bytes, size, MSG_NOSIGNAL);
+        if(n <= 0) return false;
+        bytes += n;
+        size -= size_t(n);
+    }
+    return true;
+}
+
+bool Connection::receive(void *data, size_t size){
+    char *bytes = static_cast<char*>(data);
+    while(size > 0){
+        ssize_t n = ::recv(fd, bytes, size, 0);
+        if(n <= 0) return false;
+        bytes += n;
+        size -= size_t(n);
+    }
+    return true;
+}
+
+unique_ptr<Connection> connect_worker(const string &address){
+    size_t colon = address.rfind(':');
+    if(colon == string::npos) RT3_ERROR("Worker address \"" + address + "\" is not host:port.");
+    string host = address.substr(0, colon), port = address.substr(colon + 1);
+
+    addrinfo hints{}, *found = nullptr;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if(getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0 || !found){
+        RT3_WARNING("Cannot resolve worker \"" + address + "\".");
+        return nullptr;
+    }
+
+    // The worker may still be loading its scene when the coordinator starts.
+    for(int attempt = 0; attempt < 50; ++attempt){
+        for(addrinfo *a = found; a; a = a->ai_next){
+            int fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if(fd < 0) continue;
+            if(connect(fd, a->ai_addr, a->ai_addrlen) == 0){
+                freeaddrinfo(found);
+                set_no_delay(fd);
+                return make_unique<Connection>(fd, address);
+            }
+            close(fd);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+    freeaddrinfo(found);
+    RT3_WARNING("Cannot reach worker \"" + address + "\".");
+    return nullptr;
+}
+
+unique_ptr<Connection> accept_coordinator(int port){
+    int listener = socket(AF_INET6, SOCK_STREAM, 0);
+    bool v6 = listener >= 0;
+    if(!v6) listener = socket(AF_INET, SOCK_STREAM, 0);
+    if(listener < 0) RT3_ERROR("Cannot open a socket for the worker.");
+    int one = 1, zero = 0;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    int bound;
+    if(v6){
+        // Dual stack: IPv4 coordinators reach it too.
+        setsockopt(listener, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+        sockaddr_in6 addr{};
+        addr.sin6_family = AF_INET6;
+        addr.sin6_addr = in6addr_any;
+        addr.sin6_port = htons(uint16_t(port));
+        bound = bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    }else{
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(uint16_t(port));
+        bound = bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    }
+    if(bound != 0 || listen(listener, 1) != 0) RT3_ERROR("Cannot listen on port " + std::to_string(port) + ".");
+
+    RT3_MESSAGE("    Worker waiting for a coordinator on port " + std::to_string(port) + ".");
+    int fd = accept(listener, nullptr, nullptr);
+    close(listener);
+    if(fd < 0) RT3_ERROR("Failed to accept the coordinator.");
+    set_no_delay(fd);
+    return make_unique<Connection>(fd, "coordinator");
+}
+
+vector<unique_ptr<Connection>> spawn_workers(int count, int threads, const RunningOptions &opt){
+    // Workers run this same executable (/proc/self/exe); argv[0] names it the way it was started.
+    vector<string> args{opt.program, "--worker-fd", "", "--nthreads", std::to_string(threads)};
+    if(opt.quick_render) args.push_back("--quick");
+    const auto &cw = opt.crop_window;
+    if(cw[0][0] != 0 || cw[0][1] != 1 || cw[1][0] != 0 || cw[1][1] != 1){
+        args.insert(args.end(), {"--cropwindow", real_arg(cw[0][0]), real_arg(cw[0][1]), real_arg(cw[1][0]), real_arg(cw[1][1])});
+    }
+    args.push_back(opt.filename);
+
+    vector<unique_ptr<Connection>> workers;
+    for(int w = 0; w < count; ++w){
+        int ends[2];
+        if(socketpair(AF_UNIX, SOCK_STREAM, 0, ends) != 0) RT3_ERROR("Cannot create a socket pair for a worker.");
+        // Only the child keeps its end open across exec.
+        fcntl(ends[0], F_SETFD, FD_CLOEXEC);
+
+        args[2] = std::to_string(ends[1]);
+        vector<char*> argv;
+        for(auto &a : args) argv.push_back(&a[0]);
+        argv.push_back(nullptr);
+
+        pid_t pid = fork();
+        if(pid < 0) RT3_ERROR("Cannot start a worker process.");
+        if(pid == 0){
+            // The coordinator's output is enough; a worker only reports errors.
+            int null = open("/dev/null", O_WRONLY);
+            if(null >= 0) dup2(null, STDOUT_FILENO);
+            execv("/proc/self/exe", argv.data());
+            _exit(127);
+        }
+        close(ends[1]);
+        workers.push_back(make_unique<Connection>(ends[0], "local worker " + std::to_string(w + 1), pid));
+    }
+    return workers;
+}
+
+uint32_t file_hash(const string &filename, uint32_t hash){
+    std::ifstream in(filename, std::ios::binary);
+    if(!in) return hash;
+    char buffer[4096];
+    while(in.read(buffer, sizeof(buffer)) || in.gcount() > 0){
+        for(std::streamsize k = 0; k < in.gcount(); ++k){
+            hash = (hash ^ uint8_t(buffer[k])) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+} // namespace rt3
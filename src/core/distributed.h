@@ -0,0 +1,57 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include "rt3.h"
+
+#include <cstdint>
+
+namespace rt3{
+
+/*!
+ * Blocking byte stream between a coordinator and one of its workers: a TCP
+ * socket, or one end of a socket pair shared with a worker this process started.
+ * Values go over as raw bytes, so both ends must run on the same kind of machine
+ * (byte order, real_type); the render handshake turns away a worker that does not.
+ */
+class Connection{
+private:
+    int fd;
+    int child; //!< Local worker process, waited for once the connection closes (-1: none).
+
+public:
+    const string name; //!< For messages: the worker's address, or "local worker <n>".
+
+    Connection(int socket, const string &_name, int pid = -1):fd(socket), child(pid), name(_name){}
+    ~Connection();
+    Connection(const Connection&) = delete;
+    Connection & operator=(const Connection&) = delete;
+
+    /// Sends/receives exactly `size` bytes; false once the other end is gone.
+    bool send(const void *data, size_t size);
+    bool receive(void *data, size_t size);
+
+    template<typename T> bool send_value(const T &value){ return send(&value, sizeof(T)); }
+    template<typename T> bool receive_value(T &value){ return receive(&value, sizeof(T)); }
+};
+
+/// Connects to a worker listening at "host:port", retrying for a few seconds while it
+/// starts up; nullptr (with a warning) if it cannot be reached.
+unique_ptr<Connection> connect_worker(const string &address);
+
+/// Waits for a coordinator on TCP `port` and returns its connection.
+unique_ptr<Connection> accept_coordinator(int port);
+
+/// Starts `count` copies of this program as workers, each with `threads` threads and
+/// the options of `opt` that change the image, talking over a socket pair.
+vector<unique_ptr<Connection>> spawn_workers(int count, int threads, const RunningOptions &opt);
+
+/// Starting value of file_hash().
+const uint32_t FNV_OFFSET_BASIS = 2166136261u;
+
+/// FNV-1a hash of a file, continued from `hash` so several files fold into one value
+/// (`hash` unchanged if the file cannot be read); see scene_files_hash().
+uint32_t file_hash(const string &filename, uint32_t hash = FNV_OFFSET_BASIS);
+
+} // namespace rt3
+
+#endif
@@ -1,20 +1,47 @@
 #include "film.h"
 #include "paramset.h"
 #include "image_io.h"
+#include "parallel.h"
+#include "rng.h"
 #include "../api/api.h"
 
 #include <cmath>
+#include <cstdio>
 
 namespace rt3 {
 
     //=== Film Method Definitions
-    Film::Film( const Point2i &resolution, const std::string &filename , image_type_t imgt ) :
+    Film::Film( const Point2i &resolution, const std::string &filename , image_type_t imgt,
+                const vector<real_type> &crop, bool composite, bool streaming ) :
         m_full_resolution{resolution},
         m_filename{filename},
-        image_type{ imgt }
+        image_type{ imgt },
+        m_composite{ composite },
+        m_streaming{ streaming }
     {
+        if ( crop.size() != 4 or crop[0] < 0 or crop[1] > 1 or crop[0] >= crop[1]
+                              or crop[2] < 0 or crop[3] > 1 or crop[2] >= crop[3] )
+            RT3_ERROR( "Crop window must be given as x0 x1 y0 y1, with 0 <= x0 < x1 <= 1 and 0 <= y0 < y1 <= 1." );
+
+        // Same rounding as pbrt: a pixel is in if its center is.
+        m_crop_begin = Point2i{{ int(std::ceil(height() * crop[2] - 0.5f)), int(std::ceil(width() * crop[0] - 0.5f)) }};
+        m_crop_end   = Point2i{{ int(std::ceil(height() * crop[3] - 0.5f)), int(std::ceil(width() * crop[1] - 0.5f)) }};
+        if ( crop_height() <= 0 or crop_width() <= 0 )
+            RT3_ERROR( "Crop window does not cover any pixel." );
+
+        if ( m_streaming )
+        {
+            // No image in memory: tiles go to the file as they are done.
+            if ( imgt != image_type_t::PPM6 and imgt != image_type_t::PFM and imgt != image_type_t::EXR )
+                RT3_ERROR( "Streaming output needs a ppm6, pfm or exr image." );
+            if ( m_composite )
+                RT3_WARNING( "A streamed crop window is written alone; crop_composite is ignored." );
+            m_composite = false;
+            return;
+        }
+
         m_color_buffer_ptr = make_unique<ColorBuffer>(
-            ColorBuffer(resolution.at(0), resolution.at(1))
+            ColorBuffer(crop_height(), crop_width())
         );
     }
 
@@ -23,27 +50,322 @@ namespace rt3 {
     }
 
     /// Add the color to image.
-    void Film::add_sample ( const Point2i &pixel_coord, const Color &pixel_color )
+    void Film::add_sample ( const Point2i &pixel_coord, const Color &pixel_color, real_type weight )
+    {
+        Point2i local{{ pixel_coord.at(0) - m_crop_begin.at(0), pixel_coord.at(1) - m_crop_begin.at(1) }};
+        float *px = m_color_buffer_ptr->at(local);
+        for ( int c = 0 ; c < 3 ; c++ ) px[c] += float(pixel_color.at(c) * weight);
+        px[3] += float(weight);
+    }
+
+    void Film::set_pixel ( const Point2i &pixel_coord, const Color &pixel_color )
+    {
+        Point2i local{{ pixel_coord.at(0) - m_crop_begin.at(0), pixel_coord.at(1) - m_crop_begin.at(1) }};
+        float *px = m_color_buffer_ptr->at(local);
+        for ( int c = 0 ; c < 3 ; c++ ) px[c] = float(pixel_color.at(c));
+        px[3] = 1;
+    }
+
+    void Film::set_filter( unique_ptr<Filter> &&f )
+    {
+        // A filtered tile spills into its neighbours, which may already be on disk.
+        if ( m_streaming and f )
+        {
+            RT3_WARNING( "Streaming output does not support reconstruction filters; the filter is ignored." );
+            f = nullptr;
+        }
+        m_filter = std::move(f);
+        m_filter_table = m_filter ? make_unique<FilterTable>( *m_filter ) : nullptr;
+    }
+
+    int Film::filter_margin() const
+    {
+        // A sample reaches the pixels whose center is within the radius.
+        return m_filter ? std::max( 0, int(std::ceil( m_filter->radius + 0.5f )) - 1 ) : 0;
+    }
+
+    unique_ptr<FilmTile> Film::film_tile( int i0, int i1, int j0, int j1 ) const
+    {
+        int m = filter_margin();
+        return make_unique<FilmTile>( std::max( i0 - m, m_crop_begin.at(0) ), std::min( i1 + m, m_crop_end.at(0) ),
+                                      std::max( j0 - m, m_crop_begin.at(1) ), std::min( j1 + m, m_crop_end.at(1) ),
+                                      *m_filter_table );
+    }
+
+    void Film::resolve( int i0, int i1, int j0, int j1, const vector<const FilmTile*> &tiles )
+    {
+        for ( int i = i0 ; i < i1 ; i++ )
+        {
+            for ( int j = j0 ; j < j1 ; j++ )
+            {
+                float *px = m_color_buffer_ptr->at( Point2i{{ i - m_crop_begin.at(0), j - m_crop_begin.at(1) }} );
+                std::fill( px, px + 4, 0.f );
+                for ( const FilmTile *tile : tiles )
+                {
+                    if ( i < tile->i0 or i >= tile->i1 or j < tile->j0 or j >= tile->j1 ) continue;
+                    const float *splat = tile->at( i, j );
+                    for ( int c = 0 ; c < 4 ; c++ ) px[c] += splat[c];
+                }
+            }
+        }
+    }
+
+    void FilmTile::save( std::ostream &out ) const
+    {
+        out.write( (const char *) m_pixels.data(), m_pixels.size() * sizeof(float) );
+    }
+
+    bool FilmTile::load( std::istream &in )
     {
-        m_color_buffer_ptr->at(pixel_coord) = ColorInt(pixel_color);
+        in.read( (char *) m_pixels.data(), m_pixels.size() * sizeof(float) );
+        return bool(in);
     }
 
+    void FilmTile::add_sample( int pi, int pj, const Point2f &offset, const Color &L )
+    {
+        // Distances are taken from the sample's own pixel: adding the offset to large pixel
+        // coordinates could round it into the next pixel.
+        // Pixel pi + d gets a share when its center, d + 0.5, is in (offset - r, offset + r].
+        // Half open, like the pixels themselves, so a box of radius 0.5 only feeds the sample's own pixel.
+        const real_type r = m_table.radius;
+        const real_type oi = offset.at(0) - 0.5f, oj = offset.at(1) - 0.5f;
+        int ki0 = std::max( pi + int(std::floor( oi - r )) + 1, i0 ), ki1 = std::min( pi + int(std::floor( oi + r )), i1 - 1 );
+        int kj0 = std::max( pj + int(std::floor( oj - r )) + 1, j0 ), kj1 = std::min( pj + int(std::floor( oj + r )), j1 - 1 );
 
+        for ( int i = ki0 ; i <= ki1 ; i++ )
+        {
+            float *px = m_pixels.data() + (size_t(i - i0) * (j1 - j0) + (kj0 - j0)) * 4;
+            for ( int j = kj0 ; j <= kj1 ; j++, px += 4 )
+            {
+                float w = float( m_table.weight( (i - pi) - oi, (j - pj) - oj ) );
+                for ( int c = 0 ; c < 3 ; c++ ) px[c] += float( L.at(c) ) * w;
+                px[3] += w;
+            }
+        }
+    }
+
+    Film::ColorBuffer::ColorBuffer( int _height, int _width ) : height(_height), width(_width)
+    {
+        // aligned_alloc() wants a multiple of the alignment.
+        size_t bytes = size_t(height) * width * CHANNELS * sizeof(float);
+        bytes = (bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        data.reset( static_cast<float*>( std::aligned_alloc( ALIGNMENT, bytes ) ) );
+        if ( not data ) RT3_ERROR( "Not enough memory for the image buffer." );
+        std::fill( data.get(), data.get() + bytes / sizeof(float), 0.f );
+    }
+
+    void Film::ColorBuffer::quantize( unsigned char *out, size_t out_width ) const
+    {
+        for ( int i = 0 ; i < height ; i++ )
+        {
+            const float *__restrict src = data.get() + size_t(i) * width * CHANNELS;
+            unsigned char *__restrict dst = out + size_t(i) * out_width * 3;
+            // Branch-free, so the compiler vectorizes it. Unsampled pixels (zero weight) come out black.
+            for ( int j = 0 ; j < width ; j++ )
+            {
+                float w = src[CHANNELS * j + 3];
+                float inv = w > 0 ? 1.f / w : 0.f;
+                for ( int c = 0 ; c < 3 ; c++ )
+                {
+                    float v = src[CHANNELS * j + c] * inv;
+                    v = v < 0.f ? 0.f : ( v > 1.f ? 1.f : v );
+                    dst[3 * j + c] = (unsigned char)( v * 255.f );
+                }
+            }
+        }
+    }
+
+
+
+    void Film::ColorBuffer::resolve( float *out ) const
+    {
+        const float *src = data.get();
+        for ( size_t p = 0 ; p < size_t(height) * width ; p++, src += CHANNELS, out += 3 )
+        {
+            float w = src[3];
+            float inv = w != 0 ? 1.f / w : 0.f;
+            for ( int c = 0 ; c < 3 ; c++ ) out[c] = src[c] * inv;
+        }
+    }
+
+    void Film::begin_stream( int tile_size )
+    {
+        m_stream = open_image_stream( image_type, m_filename + ".tmp", crop_height(), crop_width(),
+                                      tile_size, exr_half, exr_compression );
+        if ( not m_stream ) RT3_ERROR( "Failed to open image stream." );
+    }
+
+    void Film::write_tile( int i0, int i1, int j0, int j1, const float *rgb )
+    {
+        if ( not m_stream->write_tile( i0 - m_crop_begin.at(0), j0 - m_crop_begin.at(1), i1 - i0, j1 - j0, rgb ) )
+            RT3_ERROR( "Failed to save image tile." );
+    }
+
+    void Film::end_stream()
+    {
+        bool result = m_stream->close();
+        m_stream = nullptr;
+        if(result) result = std::rename( (m_filename + ".tmp").c_str(), m_filename.c_str() ) == 0;
+        if(!result) RT3_ERROR("Failed to save image.");
+    }
+
+    void Film::set_aovs( const vector<aov_type_t> &aovs )
+    {
+        m_aovs = aovs;
+        m_aov_pixels.assign( m_aovs.empty() ? 0 : size_t(crop_height()) * crop_width(), AovPixel{} );
+    }
+
+    void Film::set_aov( const Point2i &p, const AovPixel &aov )
+    {
+        m_aov_pixels[size_t(p.at(0) - m_crop_begin.at(0)) * crop_width() + (p.at(1) - m_crop_begin.at(1))] = aov;
+    }
+
+    std::string Film::aov_filename( aov_type_t aov ) const
+    {
+        return insert_before_extension( m_filename, "_" + aov_type_t_names[int(aov)] );
+    }
+
+    /*!
+     * HDR formats get the raw values: distance, normal, albedo, and the primitive
+     * index as a number (-1: none), repeated in every channel where it is a scalar.
+     * 8-bit formats get something to look at: depth from black (nearest hit) to
+     * white (farthest hit, or nothing), normals mapped from [-1,1] to [0,1], and
+     * a random color per primitive.
+     */
+    void Film::write_aovs() const
+    {
+        const size_t h = crop_height(), w = crop_width();
+        const bool hdr = image_type == image_type_t::PFM or image_type == image_type_t::EXR;
+
+        real_type nearest = INF, farthest = 0;
+        for ( const AovPixel &p : m_aov_pixels )
+        {
+            if ( p.depth >= INF ) continue;
+            nearest = std::min( nearest, p.depth );
+            farthest = std::max( farthest, p.depth );
+        }
+        const real_type range = farthest > nearest ? farthest - nearest : 1;
+
+        std::vector<float> values( h * w * 3 );
+        for ( aov_type_t aov : m_aovs )
+        {
+            for ( size_t k = 0; k < m_aov_pixels.size(); ++k )
+            {
+                const AovPixel &p = m_aov_pixels[k];
+                float *v = values.data() + 3 * k;
+                switch ( aov )
+                {
+                    case aov_type_t::depth:
+                        v[0] = v[1] = v[2] = float( hdr ? p.depth : p.depth >= INF ? 1 : (p.depth - nearest) / range );
+                        break;
+                    case aov_type_t::normal:
+                        for ( int c = 0; c < 3; ++c )
+                            v[c] = float( hdr or p.depth >= INF ? p.normal.at(c) : (p.normal.at(c) + 1) * real_type(0.5) );
+                        break;
+                    case aov_type_t::albedo:
+                        for ( int c = 0; c < 3; ++c ) v[c] = float( p.albedo.at(c) );
+                        break;
+                    case aov_type_t::primitive_id:
+                        if ( hdr or p.primitive < 0 )
+                            v[0] = v[1] = v[2] = float( hdr ? p.primitive : 0 );
+                        else
+                            for ( int c = 0; c < 3; ++c )
+                                v[c] = float( to_unit( RandomStream::bits( p.primitive, 0, RandomStream::PIXEL, c ) ) );
+                        break;
+                }
+            }
+
+            std::string filename = aov_filename( aov ), tmp_filename = filename + ".tmp";
+            bool result = false;
+            if ( image_type == image_type_t::PFM )
+                result = save_pfm( values.data(), h, w, tmp_filename );
+            else if ( image_type == image_type_t::EXR )
+            {
+                // Half floats would round distances and primitive numbers.
+                bool half = exr_half and ( aov == aov_type_t::normal or aov == aov_type_t::albedo );
+                result = save_exr( values.data(), h, w, half, exr_compression, tmp_filename );
+            }
+            else
+            {
+                std::vector<unsigned char> bytes( values.size() );
+                for ( size_t k = 0; k < values.size(); ++k )
+                    bytes[k] = (unsigned char)( std::min( std::max( values[k], 0.f ), 1.f ) * 255 );
+                if ( image_type == image_type_t::PPM3 )
+                    result = save_ppm3( bytes.data(), h, w, 3, tmp_filename );
+                else if ( image_type == image_type_t::PPM6 )
+                    result = save_ppm6( bytes.data(), h, w, 3, tmp_filename );
+                else
+                    result = save_png( bytes.data(), h, w, 3, tmp_filename, png_compression, encode_threads );
+            }
+            if ( result ) result = std::rename( tmp_filename.c_str(), filename.c_str() ) == 0;
+            if ( !result ) RT3_ERROR( "Failed to save the " + aov_type_t_names[int(aov)] + " AOV." );
+        }
+    }
 
     /// Convert image to RGB, compute final pixel values, write image.
+    /// The image goes to a temporary file first, which then replaces the output file:
+    /// partial images written during a progressive render are never seen half written.
     void Film::write_image(void) const
     {
+        if ( m_streaming ) RT3_ERROR( "A streaming film is written tile by tile." );
+        if ( has_aovs() ) write_aovs();
+
         bool result = false;
-        auto blob_ptr = m_color_buffer_ptr->getBlob();
+        std::string tmp_filename = m_filename + ".tmp";
+        size_t out_h = crop_height(), out_w = crop_width();
+
+        // HDR formats take the linear values, unclamped and unquantized.
+        if ( image_type == image_type_t::PFM or image_type == image_type_t::EXR )
+        {
+            if ( m_composite and is_cropped() )
+                RT3_WARNING( "Crop windows are only composited into PNG images; writing the crop window alone." );
+            std::vector<float> linear( out_h * out_w * 3 );
+            m_color_buffer_ptr->resolve( linear.data() );
+            if ( image_type == image_type_t::PFM )
+                result = save_pfm( linear.data(), out_h, out_w, tmp_filename );
+            else
+                result = save_exr( linear.data(), out_h, out_w, exr_half, exr_compression, tmp_filename );
+            if(result) result = std::rename( tmp_filename.c_str(), m_filename.c_str() ) == 0;
+            if(!result) RT3_ERROR("Failed to save image.");
+            return;
+        }
+
+        std::vector<unsigned char> bytes;
+
+        // Crop window pasted into the previous (full) image? It is quantized straight into it.
+        bool composited = false;
+        if ( m_composite and is_cropped() )
+        {
+            size_t h, w;
+            if ( image_type == image_type_t::PNG and load_png( m_filename, bytes, h, w )
+                 and int(h) == height() and int(w) == width() )
+            {
+                m_color_buffer_ptr->quantize( bytes.data() + (size_t(m_crop_begin.at(0)) * w + m_crop_begin.at(1)) * 3, w );
+                out_h = h;
+                out_w = w;
+                composited = true;
+            }
+            else
+            {
+                RT3_WARNING( "No " + std::to_string(width()) + "x" + std::to_string(height()) + " PNG image in \""
+                             + m_filename + "\" to paste the crop window into; writing the crop window alone." );
+            }
+        }
+        if ( not composited )
+        {
+            bytes.resize( out_h * out_w * 3 );
+            m_color_buffer_ptr->quantize( bytes.data(), out_w );
+        }
+        unsigned char *blob_ptr = bytes.data();
 
         if(image_type == image_type_t::PPM3){
-            result = save_ppm3( blob_ptr, height(), width(), 3,  m_filename);
+            result = save_ppm3( blob_ptr, out_h, out_w, 3,  tmp_filename);
         } else if(image_type == image_type_t::PPM6){
-            result = save_ppm6( blob_ptr, height(), width(), 3,  m_filename);
+            result = save_ppm6( blob_ptr, out_h, out_w, 3,  tmp_filename);
         } else if(image_type == image_type_t::PNG){
-            result = save_png( blob_ptr, height(), width(), 3,  m_filename);
+            result = save_png( blob_ptr, out_h, out_w, 3,  tmp_filename, png_compression, encode_threads );
         }
-        // delete blob_ptr;
+        if(result) result = std::rename( tmp_filename.c_str(), m_filename.c_str() ) == 0;
         if(!result) RT3_ERROR("Failed to save image.");
     }
     
@@ -87,7 +409,29 @@ namespace rt3 {
             yres = std::max(1, yres / 4);
         }
 
-        // Note that the image type is fixed here. Must be read from ParamSet, though.
-        return new Film( Point2i{{yres, xres}}, filename, image_type_t::PNG );
+        // Crop window: the command line one wins over the scene file's.
+        const auto &cw = API::curr_run_opt.crop_window;
+        vector<real_type> crop{ cw[0][0], cw[0][1], cw[1][0], cw[1][1] };
+        if ( crop == vector<real_type>{0, 1, 0, 1} )
+            crop = retrieve( ps, "crop_window", crop );
+
+        Film *film = new Film( Point2i{{yres, xres}}, filename, retrieve( ps, "img_type", image_type_t::PNG ),
+                               crop, retrieve( ps, "crop_composite", false ), retrieve( ps, "streaming", false ) );
+        film->exr_half = retrieve( ps, "exr_half", true );
+        film->exr_compression = retrieve( ps, "exr_compression", exr_compression_t::zip );
+        film->png_compression = retrieve( ps, "png_compression", int(6) );
+        if ( film->png_compression < 0 or film->png_compression > 9 )
+            RT3_ERROR( "The PNG compression level must be in [0, 9]." );
+        film->encode_threads = resolve_thread_count( API::curr_run_opt.nthreads );
+
+        // AOVs, each written once.
+        vector<aov_type_t> aovs;
+        for ( aov_type_t aov : retrieve( ps, "aovs", vector<aov_type_t>{} ) )
+            if ( std::find( aovs.begin(), aovs.end(), aov ) == aovs.end() ) aovs.push_back( aov );
+        if ( !aovs.empty() and film->is_streaming() )
+            RT3_WARNING( "A streaming film writes no AOVs." );
+        else
+            film->set_aovs( aovs );
+        return film;
     }
 }  // namespace pbrt
@@ -4,63 +4,160 @@
 #include "rt3.h"
 #include "error.h"
 #include "paramset.h"
+#include "filter.h"
+
+#include <cstdlib>
 
 namespace rt3 {
 
+    /*!
+     * The samples of one image tile, splatted with the film's reconstruction filter
+     * into every pixel within its radius. The tile covers the pixels those samples
+     * can reach, so neighbouring tiles overlap; each one is filled by a single
+     * thread, and Film::resolve() adds them up in a fixed order afterwards.
+     */
+    class FilmTile {
+        public:
+            const int i0, i1, j0, j1; //!< Pixels [i0, i1) x [j0, j1) it holds.
+
+            FilmTile( int _i0, int _i1, int _j0, int _j1, const FilterTable &table ) :
+                i0(_i0), i1(_i1), j0(_j0), j1(_j1), m_table(table),
+                m_pixels( size_t(_i1 - _i0) * (_j1 - _j0) * 4, 0.f ) {}
+
+            /// Splats the radiance `L` of a sample at `offset` (in [0,1)^2) inside pixel (i, j).
+            void add_sample( int i, int j, const Point2f &offset, const Color &L );
+
+            /// Raw copy of the splats, for checkpoints; load() is false if the data does not fit.
+            void save( std::ostream &out ) const;
+            bool load( std::istream &in );
+            size_t saved_size() const { return m_pixels.size() * sizeof(float); }
+
+            /// Weighted sum of the samples (RGB) and of their weights (A) at pixel (i, j).
+            const float* at( int i, int j ) const { return m_pixels.data() + (size_t(i - i0) * (j1 - j0) + (j - j0)) * 4; }
+
+        private:
+            const FilterTable &m_table;
+            vector<float> m_pixels;
+    };
+
+    class ImageStream;
+
+    /// First-hit data of a pixel, averaged over its samples, for the AOVs.
+    struct AovPixel{
+        real_type depth = INF; //!< Distance to the hit along the camera rays (INF: no sample hit).
+        Normal3f normal;       //!< Surface normal (zero if no sample hit).
+        Color albedo;          //!< Diffuse reflectance of the material hit.
+        int primitive = -1;    //!< Primitive seen by the pixel's first sample (-1: none).
+    };
+
     /// Represents an image generated by the ray tracer.
     class Film {
+        /// Row-major, 64-byte aligned RGBA float pixels. RGB holds the weighted sum
+        /// of the samples and A their total weight; pixels are only normalized and
+        /// quantized to 8 bits when the image is written.
         struct ColorBuffer{
-            
-            vector<vector<ColorInt>> data;
-            int height, width;
+            static const int CHANNELS = 4;
+            static const size_t ALIGNMENT = 64;
 
+            struct Deleter{ void operator()(float *p) const { std::free(p); } };
+            std::unique_ptr<float[], Deleter> data;
+            int height, width;
 
-            ColorBuffer(int _height, int _width): height(_height), width(_width){
-                data = vector<vector<ColorInt>>(height, vector<ColorInt>(width));
-            }
+            ColorBuffer(int _height, int _width);
 
-            ColorInt& at(Point2i coord){
-                return data[coord[0]][coord[1]];
+            float* at(const Point2i &coord){
+                return data.get() + (size_t(coord.at(0)) * width + coord.at(1)) * CHANNELS;
             }
 
-            unsigned char* getBlob(){
-                unsigned char * byte_data = new unsigned char[width * height * 3];
-                int currPos = 0;
-                for(auto &row : data){
-                    for(auto &c : row){
-                        for(int i = 0; i < 3; ++i){
-                            byte_data[currPos++] = c[i];
-                        }
-                    }
-                }
-                return byte_data;
-            }
+            /// Writes the normalized pixels as 8-bit RGB into `out`, whose rows are `out_width` pixels long.
+            void quantize(unsigned char *out, size_t out_width) const;
+            /// Writes the normalized pixels as float RGB into `out` (height x width), unclamped.
+            void resolve(float *out) const;
         };
 
         public:
 
             //=== Film Public Methods
-            Film( const Point2i &resolution, const std::string &filename, image_type_t imgt );
+            /// `crop` is the region to render (x0, x1, y0, y1, as fractions of the width and height,
+            /// from the top left corner); only its pixels are kept. With `composite`, they are pasted
+            /// into the image already in the output file (if it has the full resolution).
+            /// A `streaming` film keeps no image: finished tiles are written to the file right away.
+            Film( const Point2i &resolution, const std::string &filename, image_type_t imgt,
+                  const vector<real_type> &crop = {0, 1, 0, 1}, bool composite = false, bool streaming = false );
             virtual ~Film();
             
             /// Retrieve original Film resolution.
             Point2i get_resolution() const { return m_full_resolution; };
-            /// Takes a sample `p` and its radiance `L` and updates the image.
-            void add_sample( const Point2i &, const Color & );
+            /// Takes a sample `p` (in full image coordinates, inside the crop window) and its radiance `L` and updates the image.
+            void add_sample( const Point2i &, const Color &, real_type weight = 1 );
+            /// Replaces pixel `p` by the (already averaged) color `L`.
+            void set_pixel( const Point2i &, const Color & );
+
+            /// Reconstruction filter the samples are splatted with (nullptr: each pixel averages its own samples).
+            void set_filter( unique_ptr<Filter> &&f );
+            bool has_filter() const { return m_filter != nullptr; }
+            /// Pixels around a pixel that its samples reach, on either side.
+            int filter_margin() const;
+            /// Splat buffer for the samples of pixels [i0, i1) x [j0, j1) (needs a filter).
+            unique_ptr<FilmTile> film_tile( int i0, int i1, int j0, int j1 ) const;
+            /// Sets pixels [i0, i1) x [j0, j1) to the sum of the splats of `tiles`, added in their order.
+            /// Calls for disjoint regions may run in parallel.
+            void resolve( int i0, int i1, int j0, int j1, const vector<const FilmTile*> &tiles );
+            /// Writes the image, and the AOVs next to it.
             void write_image() const;
 
+            /// First-hit data to write, each in its own file (see aov_filename()), along with the image.
+            void set_aovs( const vector<aov_type_t> &aovs );
+            const vector<aov_type_t> &aovs() const { return m_aovs; }
+            bool has_aovs() const { return !m_aovs.empty(); }
+            /// Replaces the AOVs of pixel `p` (in full image coordinates, inside the crop window).
+            void set_aov( const Point2i &p, const AovPixel &aov );
+            /// "<image name>_<aov>.<extension>".
+            std::string aov_filename( aov_type_t aov ) const;
+
+            bool is_streaming() const { return m_streaming; }
+            /// Opens the output of a streaming film, whose tiles are `tile_size` pixels wide, from the crop origin.
+            void begin_stream( int tile_size );
+            /// Writes the finished pixels [i0, i1) x [j0, j1) of a streaming film, as RGB floats row by row.
+            /// Tiles may come from several threads at once.
+            void write_tile( int i0, int i1, int j0, int j1, const float *rgb );
+            /// Completes the output once every tile is written.
+            void end_stream();
+
             //=== Film Public Data
             const Point2i m_full_resolution;    //!< The image's full resolution values.
             std::string m_filename;       //!< Full path file name + extension.
-            image_type_t image_type; //!< Image type, PNG, PPM3, PPM6.
+            image_type_t image_type; //!< Image type, PNG, PPM3, PPM6, PFM, EXR.
+            bool exr_half = true;    //!< EXR channels as half (16-bit) floats, instead of 32-bit ones.
+            exr_compression_t exr_compression = exr_compression_t::zip;
+            int png_compression = 6; //!< Deflate level of PNG images: 0 (none), 1 (fastest) to 9 (smallest).
+            int encode_threads = 1;  //!< Threads compressing a PNG image.
+            Point2i m_crop_begin, m_crop_end; //!< Pixels (row, column) of the crop window: [begin, end).
+            bool m_composite;             //!< Paste the crop window into the existing output image.
+            bool m_streaming;
+            unique_ptr<ImageStream> m_stream;
+            unique_ptr<Filter> m_filter;
+            unique_ptr<FilterTable> m_filter_table;
             
 
+            vector<aov_type_t> m_aovs;
+            vector<AovPixel> m_aov_pixels; //!< Crop window, row by row (empty without AOVs).
+
             // Create the matrix (or vector) that will hold the image data.
             std::unique_ptr< ColorBuffer > m_color_buffer_ptr; //!< Reference to the color buffer (image) object.
             
             int height() const { return m_full_resolution.at(0); }
             int width() const { return m_full_resolution.at(1); } 
+            /// Size of the crop window, which is what gets rendered.
+            int crop_height() const { return m_crop_end.at(0) - m_crop_begin.at(0); }
+            int crop_width() const { return m_crop_end.at(1) - m_crop_begin.at(1); }
+            const Point2i &crop_begin() const { return m_crop_begin; }
+            const Point2i &crop_end() const { return m_crop_end; }
+            bool is_cropped() const { return crop_height() != height() || crop_width() != width(); }
             real_type get_aspect() const { return ((real_type) width()) /  height(); }
+
+        private:
+            void write_aovs() const;
             
 
     };
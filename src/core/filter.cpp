@@ -0,0 +1,51 @@
+#include "filter.h"
+
+namespace rt3{
+
+real_type BoxFilter::evaluate(real_type x, real_type y) const{
+    return std::abs(x) <= radius && std::abs(y) <= radius ? 1 : 0;
+}
+
+real_type TriangleFilter::evaluate(real_type x, real_type y) const{
+    return max(real_type(0), radius - std::abs(x)) * max(real_type(0), radius - std::abs(y));
+}
+
+GaussianFilter::GaussianFilter(real_type r, real_type a):
+    Filter(r), alpha(a), expRadius(std::exp(-a * r * r)){}
+
+real_type GaussianFilter::gaussian(real_type d) const{
+    return max(real_type(0), real_type(std::exp(-alpha * d * d)) - expRadius);
+}
+
+real_type GaussianFilter::evaluate(real_type x, real_type y) const{
+    return gaussian(x) * gaussian(y);
+}
+
+real_type MitchellFilter::mitchell_1d(real_type x) const{
+    // The cubic is defined over [-2, 2].
+    x = std::abs(2 * x / radius);
+    if(x > 2) return 0;
+    if(x > 1){
+        return ((-B - 6 * C) * x * x * x + (6 * B + 30 * C) * x * x +
+                (-12 * B - 48 * C) * x + (8 * B + 24 * C)) / 6;
+    }
+    return ((12 - 9 * B - 6 * C) * x * x * x + (-18 + 12 * B + 6 * C) * x * x +
+            (6 - 2 * B)) / 6;
+}
+
+real_type MitchellFilter::evaluate(real_type x, real_type y) const{
+    return mitchell_1d(x) * mitchell_1d(y);
+}
+
+FilterTable::FilterTable(const Filter &filter):
+    radius(filter.radius), toIndex(SIZE / filter.radius){
+    // Each entry holds the filter at the center of its cell.
+    for(int y = 0; y < SIZE; ++y){
+        for(int x = 0; x < SIZE; ++x){
+            table[y * SIZE + x] = filter.evaluate((x + real_type(0.5)) * radius / SIZE,
+                                                  (y + real_type(0.5)) * radius / SIZE);
+        }
+    }
+}
+
+} // namespace rt3
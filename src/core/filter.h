@@ -0,0 +1,83 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include "rt3.h"
+
+namespace rt3{
+
+/*!
+ * Pixel reconstruction filter: the weight a sample gets in a pixel whose
+ * center lies (x, y) away from it. It vanishes beyond `radius` on either axis.
+ * The film does not evaluate it per sample, but looks it up in a FilterTable.
+ */
+class Filter{
+public:
+    const real_type radius;
+
+    Filter(real_type r):radius(r){}
+    virtual ~Filter() = default;
+
+    virtual real_type evaluate(real_type x, real_type y) const = 0;
+};
+
+/// Same weight for every sample within the radius (0.5: each pixel averages its own samples).
+class BoxFilter : public Filter{
+public:
+    using Filter::Filter;
+    real_type evaluate(real_type x, real_type y) const override;
+};
+
+/// Tent: weight falls linearly to 0 at the radius, on each axis.
+class TriangleFilter : public Filter{
+public:
+    using Filter::Filter;
+    real_type evaluate(real_type x, real_type y) const override;
+};
+
+/// Gaussian of falloff `alpha`, shifted so it reaches 0 at the radius.
+class GaussianFilter : public Filter{
+private:
+    const real_type alpha, expRadius;
+    real_type gaussian(real_type d) const;
+public:
+    GaussianFilter(real_type r, real_type a);
+    real_type evaluate(real_type x, real_type y) const override;
+};
+
+/// Mitchell-Netravali cubic; (B, C) = (1/3, 1/3) is the usual compromise between ringing and blur.
+class MitchellFilter : public Filter{
+private:
+    const real_type B, C;
+    real_type mitchell_1d(real_type x) const;
+public:
+    MitchellFilter(real_type r, real_type b, real_type c):Filter(r), B(b), C(c){}
+    real_type evaluate(real_type x, real_type y) const override;
+};
+
+/*!
+ * The filter sampled over [0, radius)^2 (filters are symmetric), so splatting a
+ * sample costs a table lookup per pixel it touches.
+ */
+class FilterTable{
+public:
+    static const int SIZE = 16;
+
+    const real_type radius;
+
+    FilterTable(const Filter &filter);
+
+    /// Weight of a sample at distance (dx, dy) from the pixel center; both must be within the radius.
+    real_type weight(real_type dx, real_type dy) const{
+        int x = min(int(std::abs(dx) * toIndex), SIZE - 1);
+        int y = min(int(std::abs(dy) * toIndex), SIZE - 1);
+        return table[y * SIZE + x];
+    }
+
+private:
+    const real_type toIndex;
+    real_type table[SIZE * SIZE];
+};
+
+} // namespace rt3
+
+#endif
@@ -3,14 +3,27 @@
 
 #include "../ext/lodepng.h"
 
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <vector>
 #include <iterator>
 #include <iostream>
+#include <map>
+#include <mutex>
 
 #include "image_io.h"
+#include "parallel.h"
+#include "stats.h"
+
+#ifdef RT3_HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 namespace rt3 {
+    static StatCounter pngImages( "Image output", "PNG images written" );
+    static StatCounter pngMicroseconds( "Image output", "PNG encoding time (us)" );
 
     /// Saves an image as a **binary** PPM file.
     bool save_ppm6( unsigned char * data, size_t h, size_t w,  size_t d,  const std::string & file_name_ )
@@ -61,9 +74,165 @@ namespace rt3 {
         return result;
     }
 
-    bool save_png( unsigned char * data, size_t h, size_t w, size_t d,  const std::string & file_name_ )
+#ifdef RT3_HAVE_ZLIB
+    namespace {
+
+        /// Filtered rows per independently compressed strip: about 256 KiB of them. It does not depend
+        /// on the number of threads, so neither does the file.
+        size_t png_strip_rows( size_t row_bytes )
+        {
+            return std::max( size_t(1), (size_t(256) << 10) / row_bytes );
+        }
+
+        inline unsigned char paeth( int a, int b, int c )
+        {
+            int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+            return (unsigned char)( pa <= pb and pa <= pc ? a : ( pb <= pc ? b : c ) );
+        }
+
+        /// Filters a row (`prev` is nullptr for the first one) into `out`: the filter type byte, then
+        /// the filtered bytes. Each of the five filters is tried and the one with the smallest sum of
+        /// absolute values kept, as most encoders do; level 0 keeps the row as it is.
+        void png_filter_row( const unsigned char *row, const unsigned char *prev, size_t n, size_t bpp,
+                             int level, unsigned char *out )
+        {
+            thread_local std::vector<unsigned char> trial, zeros;
+            trial.resize( n );
+            if ( not prev )
+            {
+                zeros.assign( n, 0 );
+                prev = zeros.data();
+            }
+            size_t best_sum = SIZE_MAX;
+            for ( int type = 0 ; type < (level == 0 ? 1 : 5) ; type++ )
+            {
+                // One loop per filter, so each one vectorizes; the first pixel has no left neighbour.
+                unsigned char *t = trial.data();
+                switch ( type )
+                {
+                    case 0: std::copy( row, row + n, t ); break;
+                    case 1:
+                        std::copy( row, row + bpp, t );
+                        for ( size_t k = bpp ; k < n ; k++ ) t[k] = row[k] - row[k - bpp];
+                        break;
+                    case 2: for ( size_t k = 0 ; k < n ; k++ ) t[k] = row[k] - prev[k]; break;
+                    case 3:
+                        for ( size_t k = 0 ; k < bpp ; k++ ) t[k] = row[k] - prev[k] / 2;
+                        for ( size_t k = bpp ; k < n ; k++ ) t[k] = row[k] - (row[k - bpp] + prev[k]) / 2;
+                        break;
+                    default:
+                        for ( size_t k = 0 ; k < bpp ; k++ ) t[k] = row[k] - prev[k];
+                        for ( size_t k = bpp ; k < n ; k++ ) t[k] = row[k] - paeth( row[k - bpp], prev[k], prev[k - bpp] );
+                }
+                size_t sum = 0;
+                for ( size_t k = 0 ; k < n ; k++ ) sum += t[k] < 128 ? t[k] : 256 - t[k];
+                if ( sum < best_sum )
+                {
+                    best_sum = sum;
+                    out[0] = (unsigned char) type;
+                    std::copy( trial.begin(), trial.end(), out + 1 );
+                }
+            }
+        }
+
+        void put_be32( std::vector<unsigned char> &out, uint32_t v )
+        {
+            for ( int b = 3 ; b >= 0 ; b-- ) out.push_back( (unsigned char)( v >> (8 * b) ) );
+        }
+
+        void put_png_chunk( std::vector<unsigned char> &out, const char *type, const unsigned char *data, size_t n )
+        {
+            put_be32( out, uint32_t(n) );
+            size_t start = out.size();
+            out.insert( out.end(), type, type + 4 );
+            out.insert( out.end(), data, data + n );
+            put_be32( out, uint32_t( crc32( 0, out.data() + start, uInt(n + 4) ) ) );
+        }
+
+        /*!
+         * PNG encoder after pigz: the image is cut into strips that are filtered and deflated
+         * independently (raw deflate, each with a fresh dictionary) by several threads. Every
+         * strip but the last ends with a sync flush, which closes it on a byte boundary with a
+         * non-final block, so the strips concatenate into a single valid zlib stream. The
+         * Adler-32 checksums of the strips are combined in order.
+         */
+        bool save_png_zlib( const unsigned char *data, size_t h, size_t w, size_t d, const std::string &file_name_,
+                            int level, int n_threads )
+        {
+            const size_t row_bytes = w * d;
+            const size_t strip_rows = png_strip_rows( row_bytes + 1 );
+            const int n_strips = int( (h + strip_rows - 1) / strip_rows );
+
+            std::vector<std::vector<unsigned char>> deflated( n_strips );
+            std::vector<uLong> adlers( n_strips );
+            std::atomic<bool> ok{ true };
+
+            parallel_for( n_strips, n_threads, [&]( int strip, int /* worker */ ) {
+                size_t r0 = size_t(strip) * strip_rows, r1 = std::min( h, r0 + strip_rows );
+                std::vector<unsigned char> filtered( (r1 - r0) * (row_bytes + 1) );
+                for ( size_t r = r0 ; r < r1 ; r++ )
+                    png_filter_row( data + r * row_bytes, r > 0 ? data + (r - 1) * row_bytes : nullptr,
+                                    row_bytes, d, level, filtered.data() + (r - r0) * (row_bytes + 1) );
+                adlers[strip] = adler32( 1, filtered.data(), uInt(filtered.size()) );
+
+                z_stream zs{};
+                if ( deflateInit2( &zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY ) != Z_OK ) { ok = false; return; }
+                auto &out = deflated[strip];
+                out.resize( deflateBound( &zs, uLong(filtered.size()) ) + 16 );
+                zs.next_in = filtered.data();
+                zs.avail_in = uInt(filtered.size());
+                zs.next_out = out.data();
+                zs.avail_out = uInt(out.size());
+                int flush = strip + 1 == n_strips ? Z_FINISH : Z_SYNC_FLUSH;
+                int status = deflate( &zs, flush );
+                if ( (flush == Z_FINISH and status != Z_STREAM_END) or (flush != Z_FINISH and status != Z_OK)
+                     or zs.avail_in != 0 )
+                    ok = false;
+                out.resize( zs.total_out );
+                deflateEnd( &zs );
+            } );
+            if ( not ok ) return false;
+
+            // zlib stream: header (deflate, 32K window, with a check making it a multiple of 31), strips, Adler-32.
+            std::vector<unsigned char> idat{ 0x78, (unsigned char)( level >= 7 ? 0xDA : level >= 2 ? 0x9C : 0x01 ) };
+            uLong adler = 1;
+            for ( int s = 0 ; s < n_strips ; s++ )
+            {
+                idat.insert( idat.end(), deflated[s].begin(), deflated[s].end() );
+                size_t r0 = size_t(s) * strip_rows, r1 = std::min( h, r0 + strip_rows );
+                adler = adler32_combine( adler, adlers[s], z_off_t( (r1 - r0) * (row_bytes + 1) ) );
+            }
+            put_be32( idat, uint32_t(adler) );
+
+            const unsigned char color_types[] = { 0, 0, 4, 2, 6 }; // grey, grey + alpha, RGB, RGBA
+            std::vector<unsigned char> header;
+            put_be32( header, uint32_t(w) );
+            put_be32( header, uint32_t(h) );
+            header.insert( header.end(), { 8, color_types[std::min( d, size_t(4) )], 0, 0, 0 } );
+
+            std::vector<unsigned char> file{ 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+            put_png_chunk( file, "IHDR", header.data(), header.size() );
+            put_png_chunk( file, "IDAT", idat.data(), idat.size() );
+            put_png_chunk( file, "IEND", nullptr, 0 );
+
+            std::ofstream ofs_file( file_name_, std::ios::out | std::ios::binary );
+            if ( not ofs_file.is_open() )
+                return false;
+            ofs_file.write( (char *)file.data(), file.size() );
+            auto result = not ofs_file.fail();
+            ofs_file.close();
+            return result;
+        }
+    }
+#endif
+
+    /// PNG through zlib when available, else through lodepng or stb (on a single thread).
+    static bool save_png_encode( unsigned char * data, size_t h, size_t w, size_t d,  const std::string & file_name_,
+                                 int level, int n_threads )
     {
-#ifdef LODEPNG
+#ifdef RT3_HAVE_ZLIB
+        return save_png_zlib( data, h, w, d, file_name_, level, n_threads );
+#elif defined(LODEPNG)
         std::cout << "depth = " << d << std::endl;
         std::vector<unsigned char> img; //( w * h * d );
         std::copy ( data, data+(w*h*d), std::back_inserter(img) );
@@ -98,7 +267,7 @@ namespace rt3 {
         // variable 'stbi_write_png_compression_level' (it defaults to 8).
         // int stbi_write_png_compression_level;    // defaults to 8; set to higher for more compression
         //
-        stbi_write_png_compression_level = 0;    // defaults to 8; set to higher for more compression
+        stbi_write_png_compression_level = level;    // defaults to 8; set to higher for more compression
         return ( 0 != stbi_write_png( file_name_.c_str(),   // file name
                     w, h,                           // image dimensions
                     d,                              // # of channels per pixel
@@ -107,6 +276,432 @@ namespace rt3 {
 #endif
     }
 
+    bool save_pfm( const float * data, size_t h, size_t w, const std::string & file_name_ )
+    {
+        std::ofstream ofs_file( file_name_, std::ios::out | std::ios::binary );
+        if ( not ofs_file.is_open() )
+            return false;
+
+        // A negative scale means little endian samples.
+        ofs_file << "PF\n"
+            << w << " " << h << "\n"
+            << "-1.0\n";
+
+        // Rows go bottom to top.
+        std::vector<unsigned char> row( w * 3 * 4 );
+        for ( size_t i = h ; i-- > 0 ; )
+        {
+            const float *src = data + i * w * 3;
+            for ( size_t k = 0 ; k < w * 3 ; k++ )
+            {
+                uint32_t bits;
+                std::memcpy( &bits, src + k, 4 );
+                for ( int b = 0 ; b < 4 ; b++ ) row[4 * k + b] = (unsigned char)( bits >> (8 * b) );
+            }
+            ofs_file.write( (char *)row.data(), row.size() );
+        }
+
+        auto result = not ofs_file.fail();
+        ofs_file.close();
+        return result;
+    }
+
+    namespace {
+
+        /// IEEE half from float, rounding to nearest even.
+        uint16_t float_to_half( float f )
+        {
+            uint32_t x;
+            std::memcpy( &x, &f, 4 );
+            uint16_t sign = (x >> 16) & 0x8000;
+            uint32_t exponent = (x >> 23) & 0xff, mantissa = x & 0x7fffff;
+
+            if ( exponent == 0xff ) // Inf or NaN (kept a NaN).
+                return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+
+            int e = int(exponent) - 127 + 15;
+            if ( e >= 31 ) // Too large: Inf.
+                return sign | 0x7c00;
+            if ( e <= 0 ) // Subnormal half, or zero.
+            {
+                if ( e < -10 ) return sign;
+                mantissa |= 0x800000;
+                int shift = 14 - e;
+                uint32_t half = mantissa >> shift, rest = mantissa & ((1u << shift) - 1), mid = 1u << (shift - 1);
+                if ( rest > mid or (rest == mid and (half & 1)) ) half++;
+                return sign | uint16_t(half);
+            }
+            uint32_t half = (uint32_t(e) << 10) | (mantissa >> 13), rest = mantissa & 0x1fff;
+            // A carry out of the mantissa correctly bumps the exponent (up to Inf).
+            if ( rest > 0x1000 or (rest == 0x1000 and (half & 1)) ) half++;
+            return sign | uint16_t(half);
+        }
+
+        template < typename T >
+        void put_le( std::vector<unsigned char> &out, T v )
+        {
+            for ( size_t b = 0 ; b < sizeof(T) ; b++ ) out.push_back( (unsigned char)( uint64_t(v) >> (8 * b) ) );
+        }
+
+        void put_attribute( std::vector<unsigned char> &out, const char *name, const char *type, const std::vector<unsigned char> &value )
+        {
+            out.insert( out.end(), name, name + std::strlen(name) + 1 );
+            out.insert( out.end(), type, type + std::strlen(type) + 1 );
+            put_le( out, int32_t(value.size()) );
+            out.insert( out.end(), value.begin(), value.end() );
+        }
+
+        /// Byte shuffle and delta predictor that RLE and ZIP compression run first.
+        void exr_predict( const std::vector<unsigned char> &in, std::vector<unsigned char> &out )
+        {
+            size_t n = in.size(), half = (n + 1) / 2;
+            out.resize( n );
+            for ( size_t k = 0 ; k < n ; k++ )
+                out[ (k % 2) ? half + k / 2 : k / 2 ] = in[k];
+            for ( size_t k = n ; k-- > 1 ; )
+                out[k] = (unsigned char)( int(out[k]) - int(out[k - 1]) + 128 + 256 );
+        }
+
+        /// OpenEXR run length encoding: a count c >= 0 repeats the next byte c + 1 times;
+        /// c < 0 copies the next -c bytes.
+        void exr_rle( const std::vector<unsigned char> &in, std::vector<unsigned char> &out )
+        {
+            const int MIN_RUN = 3, MAX_RUN = 127;
+            out.clear();
+            size_t n = in.size(), start = 0;
+            while ( start < n )
+            {
+                size_t end = start + 1;
+                while ( end < n and in[end] == in[start] and int(end - start) <= MAX_RUN ) end++;
+                if ( int(end - start) >= MIN_RUN )
+                {
+                    out.push_back( (unsigned char)( end - start - 1 ) );
+                    out.push_back( in[start] );
+                }
+                else
+                {
+                    // Literals up to the next run of three.
+                    end = start;
+                    while ( end < n and int(end - start) < MAX_RUN and
+                            not ( end + 2 < n and in[end] == in[end + 1] and in[end] == in[end + 2] ) ) end++;
+                    out.push_back( (unsigned char)( -int(end - start) ) );
+                    out.insert( out.end(), in.begin() + start, in.begin() + end );
+                }
+                start = end;
+            }
+        }
+    }
+
+    namespace {
+
+        /// Header of a scanline EXR image, or of a tiled one (one level) when `tile_size` > 0.
+        std::vector<unsigned char> exr_header( size_t h, size_t w, bool half, exr_compression_t compression,
+                                               size_t tile_size = 0 )
+        {
+            // Bit 9 of the version field flags single part tiled files.
+            std::vector<unsigned char> file{ 0x76, 0x2f, 0x31, 0x01, 2, (unsigned char)( tile_size ? 2 : 0 ), 0, 0 };
+
+            std::vector<unsigned char> value;
+            for ( const char *channel : { "B", "G", "R" } ) // Channels go in alphabetical order.
+            {
+                value.push_back( (unsigned char) channel[0] );
+                value.push_back( 0 );
+                put_le( value, int32_t(half ? 1 : 2) ); // pixel type: HALF or FLOAT
+                put_le( value, int32_t(0) );            // pLinear + reserved
+                put_le( value, int32_t(1) );            // x sampling
+                put_le( value, int32_t(1) );            // y sampling
+            }
+            value.push_back( 0 );
+            put_attribute( file, "channels", "chlist", value );
+
+            put_attribute( file, "compression", "compression", { (unsigned char) compression } );
+
+            value.clear();
+            for ( int32_t v : { 0, 0, int32_t(w) - 1, int32_t(h) - 1 } ) put_le( value, v );
+            put_attribute( file, "dataWindow", "box2i", value );
+            put_attribute( file, "displayWindow", "box2i", value );
+
+            // Tiles are stored as they get done, hence in no particular order.
+            put_attribute( file, "lineOrder", "lineOrder", { (unsigned char)( tile_size ? 2 : 0 ) } );
+
+            float one = 1, zero = 0;
+            value.assign( (unsigned char *)&one, (unsigned char *)&one + 4 );
+            put_attribute( file, "pixelAspectRatio", "float", value );
+            put_attribute( file, "screenWindowWidth", "float", value );
+            value.assign( (unsigned char *)&zero, (unsigned char *)&zero + 4 );
+            value.insert( value.end(), (unsigned char *)&zero, (unsigned char *)&zero + 4 );
+            put_attribute( file, "screenWindowCenter", "v2f", value );
+
+            if ( tile_size )
+            {
+                value.clear();
+                put_le( value, uint32_t(tile_size) );
+                put_le( value, uint32_t(tile_size) );
+                value.push_back( 0 ); // ONE_LEVEL, rounding down
+                put_attribute( file, "tiles", "tiledesc", value );
+            }
+            file.push_back( 0 );
+            return file;
+        }
+
+        /// Encodes `rows` x `cols` pixels (RGB floats, rows `stride` pixels apart) as the data of an EXR
+        /// scanline block or tile: every line holds all its B values, then its G values, then its R values.
+        bool exr_block( const float *data, size_t rows, size_t cols, size_t stride, bool half,
+                        exr_compression_t compression, std::vector<unsigned char> &out )
+        {
+            thread_local std::vector<unsigned char> raw, shuffled;
+            raw.clear();
+            for ( size_t y = 0 ; y < rows ; y++ )
+            {
+                for ( int c = 2 ; c >= 0 ; c-- )
+                {
+                    for ( size_t x = 0 ; x < cols ; x++ )
+                    {
+                        float f = data[ (y * stride + x) * 3 + c ];
+                        if ( half ) put_le( raw, float_to_half( f ) );
+                        else { uint32_t bits; std::memcpy( &bits, &f, 4 ); put_le( raw, bits ); }
+                    }
+                }
+            }
+
+            out.clear();
+            if ( compression != exr_compression_t::none )
+            {
+                exr_predict( raw, shuffled );
+                if ( compression == exr_compression_t::rle ) exr_rle( shuffled, out );
+                else if ( lodepng::compress( out, shuffled.data(), shuffled.size() ) ) return false;
+                // Blocks that would not shrink are stored as they are; readers tell by the size.
+                if ( out.size() < raw.size() ) return true;
+            }
+            out = raw;
+            return true;
+        }
+
+        /// Writes the bytes at `offset`; callers hold the stream's lock.
+        bool write_at( std::ofstream &file, uint64_t offset, const unsigned char *bytes, size_t n )
+        {
+            file.seekp( std::streamoff( offset ) );
+            file.write( (const char *) bytes, n );
+            return not file.fail();
+        }
+
+        /*!
+         * PPM6 or PFM. Tiles are gathered into bands of `tile_size` whole rows, and a band is
+         * written (in one go, at its place in the file) as soon as its last tile is in. Tiles are
+         * handed out in row order, so only the bands the threads are working on are in memory.
+         */
+        class RasterStream : public ImageStream {
+            private:
+                struct Band {
+                    std::vector<unsigned char> bytes; //!< The band's rows, in file order.
+                    size_t missing;                   //!< Pixels not written yet.
+                };
+
+                std::ofstream m_file;
+                std::mutex m_mutex;
+                size_t m_h, m_w, m_band_rows, m_bpp;
+                bool m_pfm;
+                uint64_t m_data_start;
+                std::map<size_t, Band> m_bands;
+                bool m_ok;
+
+                /// File line of image row i: PFM rows go bottom to top.
+                size_t line( size_t i ) const { return m_pfm ? m_h - 1 - i : i; }
+
+            public:
+                RasterStream( const std::string &file_name_, size_t h, size_t w, size_t tile_size, bool pfm ) :
+                    m_file( file_name_, std::ios::out | std::ios::binary ), m_h(h), m_w(w),
+                    m_band_rows( std::max( size_t(1), tile_size ) ), m_bpp( pfm ? 12 : 3 ), m_pfm(pfm)
+                {
+                    if ( m_pfm ) m_file << "PF\n" << w << " " << h << "\n" << "-1.0\n";
+                    else m_file << "P6\n" << w << " " << h << "\n" << "255\n";
+                    m_data_start = uint64_t( m_file.tellp() );
+                    m_ok = m_file.is_open() and not m_file.fail();
+                }
+
+                bool write_tile( size_t i0, size_t j0, size_t h, size_t w, const float *rgb ) override
+                {
+                    // Encoded outside the lock.
+                    thread_local std::vector<unsigned char> tile;
+                    tile.resize( h * w * m_bpp );
+                    for ( size_t k = 0 ; k < h * w * 3 ; k++ )
+                    {
+                        if ( m_pfm )
+                        {
+                            uint32_t bits;
+                            std::memcpy( &bits, rgb + k, 4 );
+                            for ( int b = 0 ; b < 4 ; b++ ) tile[4 * k + b] = (unsigned char)( bits >> (8 * b) );
+                        }
+                        else
+                        {
+                            // Same quantization as the in-memory film.
+                            float v = rgb[k] < 0.f ? 0.f : ( rgb[k] > 1.f ? 1.f : rgb[k] );
+                            tile[k] = (unsigned char)( v * 255.f );
+                        }
+                    }
+
+                    std::lock_guard<std::mutex> lock( m_mutex );
+                    for ( size_t i = i0 ; i < i0 + h ; )
+                    {
+                        size_t index = i / m_band_rows;
+                        size_t r0 = index * m_band_rows, r1 = std::min( m_h, r0 + m_band_rows );
+                        auto it = m_bands.find( index );
+                        if ( it == m_bands.end() )
+                            it = m_bands.emplace( index, Band{ std::vector<unsigned char>( (r1 - r0) * m_w * m_bpp ),
+                                                               (r1 - r0) * m_w } ).first;
+                        Band &band = it->second;
+
+                        const size_t first_line = std::min( line( r0 ), line( r1 - 1 ) );
+                        for ( ; i < std::min( r1, i0 + h ) ; i++ )
+                        {
+                            std::memcpy( band.bytes.data() + ((line( i ) - first_line) * m_w + j0) * m_bpp,
+                                         tile.data() + (i - i0) * w * m_bpp, w * m_bpp );
+                            band.missing -= w;
+                        }
+                        if ( band.missing == 0 )
+                        {
+                            m_ok = m_ok and write_at( m_file, m_data_start + uint64_t(first_line) * m_w * m_bpp,
+                                                      band.bytes.data(), band.bytes.size() );
+                            m_bands.erase( it );
+                        }
+                    }
+                    return m_ok;
+                }
+
+                bool close() override
+                {
+                    if ( not m_bands.empty() ) m_ok = false; // Some tile is missing.
+                    m_file.close();
+                    return m_ok and not m_file.fail();
+                }
+        };
+
+        /// Tiled EXR: tiles are appended as they come, and the tile offset table is filled in at the end.
+        class ExrTileStream : public ImageStream {
+            private:
+                std::ofstream m_file;
+                std::mutex m_mutex;
+                size_t m_tile, m_tiles_x;
+                bool m_half;
+                exr_compression_t m_compression;
+                uint64_t m_table, m_end;
+                std::vector<uint64_t> m_offsets;
+                bool m_ok;
+
+            public:
+                ExrTileStream( const std::string &file_name_, size_t h, size_t w, size_t tile_size, bool half,
+                               exr_compression_t compression ) :
+                    m_file( file_name_, std::ios::out | std::ios::binary ), m_tile(tile_size),
+                    m_tiles_x( (w + tile_size - 1) / tile_size ), m_half(half), m_compression(compression),
+                    m_offsets( m_tiles_x * ((h + tile_size - 1) / tile_size), 0 )
+                {
+                    auto header = exr_header( h, w, half, compression, tile_size );
+                    m_table = header.size();
+                    m_end = m_table + 8 * m_offsets.size();
+                    m_ok = m_file.is_open() and write_at( m_file, 0, header.data(), header.size() );
+                }
+
+                bool write_tile( size_t i0, size_t j0, size_t h, size_t w, const float *rgb ) override
+                {
+                    if ( i0 % m_tile or j0 % m_tile ) return m_ok = false;
+                    thread_local std::vector<unsigned char> chunk, data;
+                    if ( not exr_block( rgb, h, w, w, m_half, m_compression, data ) ) return m_ok = false;
+
+                    size_t tx = j0 / m_tile, ty = i0 / m_tile;
+                    chunk.clear();
+                    for ( int32_t v : { int32_t(tx), int32_t(ty), 0, 0, int32_t(data.size()) } ) put_le( chunk, v );
+                    chunk.insert( chunk.end(), data.begin(), data.end() );
+
+                    std::lock_guard<std::mutex> lock( m_mutex );
+                    m_offsets[ ty * m_tiles_x + tx ] = m_end;
+                    m_ok = m_ok and write_at( m_file, m_end, chunk.data(), chunk.size() );
+                    m_end += chunk.size();
+                    return m_ok;
+                }
+
+                bool close() override
+                {
+                    std::vector<unsigned char> table;
+                    for ( uint64_t offset : m_offsets )
+                    {
+                        if ( offset == 0 ) m_ok = false; // A tile is missing.
+                        put_le( table, offset );
+                    }
+                    m_ok = m_ok and write_at( m_file, m_table, table.data(), table.size() );
+                    m_file.close();
+                    return m_ok and not m_file.fail();
+                }
+        };
+    }
+
+    bool save_exr( const float * data, size_t h, size_t w, bool half, exr_compression_t compression,
+                   const std::string & file_name_ )
+    {
+        const size_t lines_per_block = compression == exr_compression_t::zip ? 16 : 1;
+        const size_t n_blocks = (h + lines_per_block - 1) / lines_per_block;
+
+        std::vector<unsigned char> file = exr_header( h, w, half, compression );
+
+        // Offset table, filled in as the blocks are added.
+        const size_t table = file.size();
+        file.resize( table + 8 * n_blocks );
+
+        std::vector<unsigned char> block_data;
+        for ( size_t block = 0 ; block < n_blocks ; block++ )
+        {
+            size_t y0 = block * lines_per_block, y1 = std::min( h, y0 + lines_per_block );
+            if ( not exr_block( data + y0 * w * 3, y1 - y0, w, w, half, compression, block_data ) ) return false;
+
+            size_t offset = file.size();
+            for ( int b = 0 ; b < 8 ; b++ ) file[ table + 8 * block + b ] = (unsigned char)( uint64_t(offset) >> (8 * b) );
+            put_le( file, int32_t(y0) );
+            put_le( file, int32_t(block_data.size()) );
+            file.insert( file.end(), block_data.begin(), block_data.end() );
+        }
+
+        std::ofstream ofs_file( file_name_, std::ios::out | std::ios::binary );
+        if ( not ofs_file.is_open() )
+            return false;
+        ofs_file.write( (char *)file.data(), file.size() );
+        auto result = not ofs_file.fail();
+        ofs_file.close();
+        return result;
+    }
+
+    std::unique_ptr<ImageStream> open_image_stream( image_type_t type, const std::string & file_name_, size_t h, size_t w,
+                                                    size_t tile_size, bool half, exr_compression_t compression )
+    {
+        std::unique_ptr<ImageStream> stream;
+        if ( type == image_type_t::PPM6 or type == image_type_t::PFM )
+            stream = std::make_unique<RasterStream>( file_name_, h, w, tile_size, type == image_type_t::PFM );
+        else if ( type == image_type_t::EXR )
+            stream = std::make_unique<ExrTileStream>( file_name_, h, w, tile_size, half, compression );
+        return stream;
+    }
+
+    bool save_png( unsigned char * data, size_t h, size_t w, size_t d,  const std::string & file_name_,
+                   int level, int n_threads )
+    {
+        level = std::max( 0, std::min( level, 9 ) );
+        auto start = std::chrono::steady_clock::now();
+        bool result = save_png_encode( data, h, w, d, file_name_, level, n_threads );
+        pngImages.add();
+        pngMicroseconds.add( std::chrono::duration_cast<std::chrono::microseconds>(
+                                 std::chrono::steady_clock::now() - start ).count() );
+        return result;
+    }
+
+    bool load_png( const std::string & file_name_, std::vector<unsigned char> & data, size_t & h, size_t & w )
+    {
+        unsigned width, height;
+        unsigned error = lodepng::decode( data, width, height, file_name_, LCT_RGB );
+        if ( error ) return false;
+
+        h = height;
+        w = width;
+        return true;
+    }
+
 }
 
 //================================[ imagem_io.h ]================================//
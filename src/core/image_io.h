@@ -2,6 +2,9 @@
 #define IMAGE_H
 
 #include <string>
+#include <vector>
+
+#include "rt3.h"
 
 namespace rt3 {
     /// Routines to write images to a file.
@@ -10,8 +13,40 @@ namespace rt3 {
     /// Saves an image as a **ascii** PPM file.
     bool save_ppm3( unsigned char * , size_t , size_t , size_t =1,  const std::string & ="image.ppm" );
 
-    /// Saves an image as a PNG file.
-    bool save_png( unsigned char * , size_t , size_t , size_t =1,  const std::string & ="image.png" );
+    /// Saves an image as a PNG file, deflated at `level` (0: stored, 1: fastest ... 9: smallest).
+    /// With zlib, horizontal strips of the image are compressed by `n_threads` threads at once.
+    bool save_png( unsigned char * , size_t , size_t , size_t =1,  const std::string & ="image.png",
+                   int level = 6, int n_threads = 1 );
+
+    /// Saves linear RGB floats (row by row, top to bottom) as a PFM file.
+    bool save_pfm( const float * , size_t h, size_t w, const std::string & ="image.pfm" );
+
+    /// Saves linear RGB floats (row by row, top to bottom) as a scanline OpenEXR file,
+    /// with half (16-bit) or full float channels.
+    bool save_exr( const float * , size_t h, size_t w, bool half = true,
+                   exr_compression_t = exr_compression_t::zip, const std::string & ="image.exr" );
+
+    /*!
+     * An image file written a tile at a time, in any order, as tiles get done, so the
+     * image never needs to be in memory as a whole. Tiles come as linear RGB floats;
+     * writing them is thread-safe.
+     */
+    class ImageStream {
+        public:
+            virtual ~ImageStream() = default;
+            /// Writes pixels [i0, i0 + h) x [j0, j0 + w), given row by row.
+            virtual bool write_tile( size_t i0, size_t j0, size_t h, size_t w, const float *rgb ) = 0;
+            /// Completes the file once every tile is in; false if anything failed.
+            virtual bool close() = 0;
+    };
+
+    /// Stream for a PPM6, PFM or (tiled, with tiles of `tile_size` pixels) EXR image; nullptr for other types.
+    std::unique_ptr<ImageStream> open_image_stream( image_type_t, const std::string &, size_t h, size_t w,
+                                                    size_t tile_size, bool half = true,
+                                                    exr_compression_t = exr_compression_t::zip );
+
+    /// Reads a PNG file as 8-bit RGB; false if it can't be read.
+    bool load_png( const std::string &, std::vector<unsigned char> &, size_t &h, size_t &w );
 }
 
 #endif
@@ -1,47 +1,631 @@
 #include "integrator.h"
 #include "material.h"
+#include "parallel.h"
+#include "image_io.h"
+#include "../materials/material_table.h"
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include <thread>
 
 namespace rt3{
 
+Color SamplerIntegrator::background_at(const unique_ptr<Scene> &scene, int i, int j) const{
+    auto w = camera->film->width();
+    auto h = camera->film->height();
+    return scene->background->sampleXYZ( Point2f{
+        {float(i)/float(h),
+        float(j)/float(w)}
+    } );
+}
+
+bool TileAccumulator::needs_samples(int i, int j) const{
+    const PixelStats &p = at(i, j);
+    if(p.count >= limit) return false;
+    if(threshold <= 0 || p.count < 2 || p.count % batch != 0) return true;
+
+    // Standard error of the mean, in the noisiest channel.
+    real_type variance = max(p.m2[0], max(p.m2[1], p.m2[2])) / (p.count - 1);
+    return variance / p.count > threshold * threshold;
+}
+
+void TileAccumulator::add_aov(int i, int j, const ObjSurfel *isect, const Color &albedo){
+    AovStats &a = aovs[size_t(i - i0) * width + (j - j0)];
+    if(a.samples++ == 0 && isect) a.primitive = isect->primitive->id;
+    if(!isect) return;
+    ++a.hits;
+    a.depth += isect->t;
+    for(int k = 0; k < 3; ++k){
+        a.normal[k] += isect->n.at(k);
+        a.albedo[k] += albedo.at(k);
+    }
+}
+
+void TileAccumulator::save(std::ostream &out) const{
+    out.write(reinterpret_cast<const char*>(pixels.data()), pixels.size() * sizeof(PixelStats));
+    if(splats) splats->save(out);
+    out.write(reinterpret_cast<const char*>(aovs.data()), aovs.size() * sizeof(AovStats));
+}
+
+bool TileAccumulator::load(std::istream &in){
+    in.read(reinterpret_cast<char*>(pixels.data()), pixels.size() * sizeof(PixelStats));
+    if(!in || (splats && !splats->load(in))) return false;
+    in.read(reinterpret_cast<char*>(aovs.data()), aovs.size() * sizeof(AovStats));
+    return bool(in);
+}
+
+namespace{
+
+/// What a checkpoint must share with the render that resumes it, and a worker with its coordinator.
+struct RenderHeader{
+    char magic[8];
+    int32_t version, realSize;
+    uint32_t scene;   //!< scene_files_hash(): the scene file and every file it includes.
+    int32_t height, width;
+    int32_t i0, i1, j0, j1, tileSize, nTiles;
+    int32_t spp, nPasses, filterMargin, batch, aovs;
+    real_type threshold;
+};
+
+/// Header of a render; zeroed first, so padding compares equal too.
+RenderHeader render_header(const Film &film, uint32_t scene, int tileSize, int nTiles, int spp, int nPasses,
+                           int batch, real_type threshold){
+    RenderHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "RT3RNDR", 8);
+    header.version = 2; // 2: `scene` also covers the included files
+    header.realSize = sizeof(real_type);
+    header.scene = scene;
+    header.height = film.height();
+    header.width = film.width();
+    header.i0 = film.crop_begin().at(0);
+    header.i1 = film.crop_end().at(0);
+    header.j0 = film.crop_begin().at(1);
+    header.j1 = film.crop_end().at(1);
+    header.tileSize = tileSize;
+    header.nTiles = nTiles;
+    header.spp = spp;
+    header.nPasses = nPasses;
+    header.filterMargin = film.has_filter() ? film.filter_margin() + 1 : 0;
+    header.batch = batch;
+    for(aov_type_t aov : film.aovs()) header.aovs |= 1 << int(aov);
+    header.threshold = threshold;
+    return header;
+}
+
+enum tile_status_t : unsigned char { PENDING, RUNNING, DONE };
+
+/*!
+ * Saves the pass under way, which of its tiles are done, and every tile: as its last
+ * render left it, or, for a tile being rendered, as it was when that render started.
+ * The file is written next to its final name and then renamed, so a render killed
+ * while saving still has the previous checkpoint.
+ */
+bool write_checkpoint(const string &file, const RenderHeader &header, int pass,
+                      const vector<TileAccumulator> &tiles, const vector<unsigned char> &status,
+                      const vector<string> &backups, vector<std::mutex> &tileMutexes){
+    string tmp = file + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(&pass), sizeof(pass));
+        for(size_t t = 0; t < tiles.size(); ++t){
+            std::lock_guard<std::mutex> lock(tileMutexes[t]);
+            unsigned char done = status[t] == DONE;
+            out.write(reinterpret_cast<const char*>(&done), 1);
+            if(status[t] == RUNNING) out.write(backups[t].data(), backups[t].size());
+            else tiles[t].save(out);
+        }
+        if(!out) return false;
+    }
+    return std::rename(tmp.c_str(), file.c_str()) == 0;
+}
+
+/// Restores the tiles saved by write_checkpoint(), marking the ones done in the saved pass;
+/// returns that pass, or -1 if there is no checkpoint.
+int read_checkpoint(const string &file, const RenderHeader &header,
+                    vector<TileAccumulator> &tiles, vector<unsigned char> &status){
+    std::ifstream in(file, std::ios::binary);
+    if(!in) return -1;
+
+    RenderHeader saved;
+    int pass = 0;
+    in.read(reinterpret_cast<char*>(&saved), sizeof(saved));
+    in.read(reinterpret_cast<char*>(&pass), sizeof(pass));
+    if(!in || std::memcmp(&saved, &header, sizeof(header)) != 0 || pass < 0 || pass > header.nPasses){
+        RT3_ERROR("The checkpoint \"" + file + "\" is not from this render (scene or included files, film or sampling settings differ).");
+    }
+    for(size_t t = 0; t < tiles.size(); ++t){
+        unsigned char done = 0;
+        in.read(reinterpret_cast<char*>(&done), 1);
+        if(!in || !tiles[t].load(in)) RT3_ERROR("The checkpoint \"" + file + "\" is truncated.");
+        status[t] = done ? DONE : PENDING;
+    }
+    return pass;
+}
+
+} // namespace
+
+void TileAccumulator::flush(Film &film, vector<int> *counts) const{
+    int height = int(pixels.size()) / width;
+    if(film.is_streaming()){
+        thread_local vector<float> rgb;
+        rgb.resize(pixels.size() * 3);
+        for(size_t p = 0; p < pixels.size(); ++p){
+            // Unclamped: the stream quantizes LDR formats itself, HDR ones keep the range.
+            for(int k = 0; k < 3; ++k) rgb[3 * p + k] = float(pixels[p].mean[k]);
+        }
+        film.write_tile(i0, i0 + height, j0, j0 + width, rgb.data());
+        return;
+    }
+
+    for(int i = 0; i < height; ++i){
+        for(int j = 0; j < width; ++j){
+            const PixelStats &p = pixels[size_t(i) * width + j];
+            Color average({p.mean[0], p.mean[1], p.mean[2]});
+            if(!splats) film.set_pixel( Point2i{{i0 + i, j0 + j}}, average );
+            if(!aovs.empty()){
+                const AovStats &a = aovs[size_t(i) * width + j];
+                AovPixel aov;
+                aov.primitive = a.primitive;
+                if(a.hits > 0){
+                    aov.depth = a.depth / a.hits;
+                    aov.normal = Normal3f({a.normal[0], a.normal[1], a.normal[2]});
+                    if(aov.normal.getNorm() > 0) aov.normal = aov.normal.normalize();
+                    aov.albedo = Color({a.albedo[0] / a.hits, a.albedo[1] / a.hits, a.albedo[2] / a.hits});
+                }
+                film.set_aov( Point2i{{i0 + i, j0 + j}}, aov );
+            }
+            if(counts){
+                size_t row = i0 + i - film.crop_begin().at(0), col = j0 + j - film.crop_begin().at(1);
+                (*counts)[row * film.crop_width() + col] = p.count;
+            }
+        }
+    }
+}
+
+void SamplerIntegrator::add_aov(const unique_ptr<Scene> &scene, TileAccumulator &pixels, int i, int j, const shared_ptr<ObjSurfel> &isect) const{
+    pixels.add_aov(i, j, isect.get(), isect ? scene->materials->albedo(isect->primitive->materialId) : Color());
+}
+
+void SamplerIntegrator::render_tile(const unique_ptr<Scene> &scene, TileAccumulator &pixels) const{
+    if(use_packets) render_block_packets(scene, pixels);
+    else render_block(scene, pixels);
+}
+
+void SamplerIntegrator::render_block(const unique_ptr<Scene> &scene, TileAccumulator &pixels) const{
+    const int i0 = pixels.i0, i1 = pixels.i1, j0 = pixels.j0, j1 = pixels.j1;
+    const int n = pixels.sample_limit();
+    thread_local vector<Point2f> offsets;
+    sampler->tile_samples(i0, i1, j0, j1, n, offsets);
+
+    // Traverse all pixels of the block to shoot rays from.
+    const Point2f *offset = offsets.data();
+    for ( int i = i0 ; i < i1; i++ ) {
+        for( int j = j0 ; j < j1 ; j++, offset += n ) {
+            auto backgroundColor = background_at(scene, i, j); // get background color.
+
+            for( int s = pixels.count(i, j); pixels.needs_samples(i, j); s++ ) {
+                Ray ray = camera->generate_ray( film_position(i, j, offset[s]) );
+                RandomStream rng(i, j, s);
+                // The first hit feeds both the AOVs and the shading.
+                shared_ptr<ObjSurfel> isect;
+                if(!scene->intersect(ray, isect)) isect = nullptr;
+                if(pixels.has_aovs()) add_aov(scene, pixels, i, j, isect);
+                pixels.add( i, j, offset[s], shade(ray, isect, scene, backgroundColor, rng) );
+            }
+        }
+    }
+}
+
+void SamplerIntegrator::render_block_packets(const unique_ptr<Scene> &scene, TileAccumulator &pixels) const{
+    const int i0 = pixels.i0, i1 = pixels.i1, j0 = pixels.j0, j1 = pixels.j1;
+    const int n = pixels.sample_limit();
+    thread_local vector<Point2f> offsets;
+    sampler->tile_samples(i0, i1, j0, j1, n, offsets);
+    const int tileWidth = j1 - j0;
+
+    RayPacket packet;
+
+    for ( int pi = i0 ; pi < i1; pi += RayPacket::WIDTH ) {
+        for( int pj = j0 ; pj < j1 ; pj += RayPacket::WIDTH ) {
+            // Next sample of the block; pixels may be at different counts (adaptive and progressive sampling).
+            int s = INT_MAX;
+            for ( int i = pi ; i < min(pi + RayPacket::WIDTH, i1); i++ ) {
+                for( int j = pj ; j < min(pj + RayPacket::WIDTH, j1) ; j++ ) {
+                    if(pixels.needs_samples(i, j)) s = min(s, pixels.count(i, j));
+                }
+            }
+
+            for( ; s < n; s++ ) {
+                // Pixels that are done, or already past this sample, leave the packet.
+                packet.clear();
+                bool more = false;
+                for ( int i = pi ; i < min(pi + RayPacket::WIDTH, i1); i++ ) {
+                    for( int j = pj ; j < min(pj + RayPacket::WIDTH, j1) ; j++ ) {
+                        if(!pixels.needs_samples(i, j)) continue;
+                        more = true;
+                        if(pixels.count(i, j) != s) continue;
+                        const Point2f &offset = offsets[(size_t(i - i0) * tileWidth + (j - j0)) * n + s];
+                        packet.add(camera->generate_ray( film_position(i, j, offset) ), i, j);
+                    }
+                }
+                if(!more) break;
+                if(packet.count == 0) continue;
+                packet.finalize();
+
+                scene->intersect_packet(packet);
+
+                for(int k = 0; k < packet.count; ++k){
+                    const Ray &ray = packet.rays[k];
+                    int i = packet.row[k], j = packet.col[k];
+
+                    shared_ptr<ObjSurfel> isect;
+                    if(!scene->packet_hit(packet, k, isect)) isect = nullptr;
+                    if(pixels.has_aovs()) add_aov(scene, pixels, i, j, isect);
+
+                    const Point2f &offset = offsets[(size_t(i - i0) * tileWidth + (j - j0)) * n + s];
+                    RandomStream rng(i, j, s);
+                    pixels.add( i, j, offset, shade(ray, isect, scene, background_at(scene, i, j), rng) );
+                }
+            }
+        }
+    }
+}
+
 void SamplerIntegrator::render( const unique_ptr<Scene> &scene ) {
     // Perform objects initialization here.
     // The Film object holds the memory for the image.
     // ...
-    auto w = camera->film->width(); // Retrieve the image dimensions in pixels.
-    auto h = camera->film->height();
+    if(camera->film->is_streaming()){
+        if(!workers.empty()) RT3_WARNING("Distributed rendering does not stream; rendering here.");
+        workers.clear();
+        render_streaming(scene);
+        return;
+    }
+    if(!workers.empty()){
+        render_distributed(scene);
+        return;
+    }
 
-    int totIts = w * h;
-    int numberSteps = 50;
-    int its = 0;
-    cout << "[ ";
+    // Only the crop window (the whole image by default) is rendered.
+    auto w = camera->film->crop_width(); // Retrieve the image dimensions in pixels.
+    auto h = camera->film->crop_height();
 
-  
+    // The region is split into square tiles, which are shared among the worker threads.
+    int nTilesX;
+    int nTiles = tile_count(nTilesX);
 
-    // Traverse all pixels to shoot rays from.
-    for ( int i = 0 ; i < h; i++ ) {
-        for( int j = 0 ; j < w ; j++ ) {
-            
-            Ray ray = camera->generate_ray( i, j );
-            auto backgroundColor = \
-                scene->background->sampleXYZ( Point2f{
-                    {float(i)/float(h),
-                    float(j)/float(w)}
-                } ); // get background color.
-            
-            
-            Color pixelColor =  Li(ray, scene, backgroundColor);
-         
-            camera->film->add_sample( Point2i{{i,j}}, pixelColor ); // set image buffer at position (i,j), accordingly.
+    if(!sample_map_file.empty()) sampleCounts.assign(size_t(w) * h, 0);
 
-            if(its % (totIts / numberSteps) == 0){
-                cout << "\b=>"; cout.flush();
-            }
-            its++;
+    // Every tile keeps its samples from one pass to the next.
+    vector<TileAccumulator> tiles;
+    tiles.reserve(nTiles);
+    for(int tile = 0; tile < nTiles; ++tile) tiles.push_back(tile_at(tile, nTilesX));
+
+    // A progressive render doubles the samples per pixel at every pass: 1, 2, 4, ..., spp.
+    const int spp = sampler->samples_per_pixel();
+    vector<int> passes;
+    if(progressive){
+        for(int limit = 1; limit < spp; limit *= 2) passes.push_back(limit);
+    }
+    passes.push_back(spp);
+
+    using Clock = std::chrono::steady_clock;
+    const auto start = Clock::now();
+    auto seconds_since = [](Clock::time_point t){
+        return std::chrono::duration<real_type>(Clock::now() - t).count();
+    };
+    std::atomic<real_type> lastWrite{0}; // seconds since start
+    std::mutex writeMutex;
+    std::atomic<bool> outOfTime{false};
+
+    // Checkpoints. A tile being rendered is saved from a copy of its state taken when it started.
+    const RenderHeader header = render_header(*camera->film, scene_id, TILE_SIZE, nTiles, spp, int(passes.size()),
+                                              adaptive_batch, adaptive_threshold);
+    const bool checkpointing = checkpoint_interval_s > 0;
+    vector<unsigned char> status(nTiles, PENDING);
+    vector<string> backups(nTiles);
+    vector<std::mutex> tileMutexes(nTiles);
+    std::atomic<real_type> lastCheckpoint{0}; // seconds since start
+    std::mutex checkpointMutex;
+    int pass = 0;
+
+    if(resume_render){
+        pass = read_checkpoint(checkpoint_file(), header, tiles, status);
+        if(pass < 0){
+            RT3_WARNING("No checkpoint in \"" + checkpoint_file() + "\"; rendering from the start.");
+            pass = 0;
+        }else{
+            RT3_MESSAGE("    Resuming from \"" + checkpoint_file() + "\" at pass " + std::to_string(pass + 1)
+                + " of " + std::to_string(passes.size()) + ".");
+            // The tiles done in the saved pass are not rendered again.
+            for(auto &pixels : tiles) flush_tile(pixels);
         }
     }
-    cout << "]\n";
+
+    ProgressReporter progress(nTiles * int(passes.size() - pass), show_progress);
+
+    int donePasses = pass;
+    for(; pass < int(passes.size()); ++pass){
+        for(auto &pixels : tiles) pixels.set_limit(passes[pass]);
+
+        parallel_for(nTiles, n_threads, [&](int tile, int /* worker */){
+            if(time_budget_s > 0 && seconds_since(start) >= time_budget_s) outOfTime = true;
+            if(outOfTime) return;
+
+            if(status[tile] != DONE){
+                if(checkpointing){
+                    std::ostringstream copy;
+                    tiles[tile].save(copy);
+                    std::lock_guard<std::mutex> lock(tileMutexes[tile]);
+                    backups[tile] = copy.str();
+                    status[tile] = RUNNING;
+                }
+                render_tile(scene, tiles[tile]);
+                flush_tile(tiles[tile]); // set image buffer at the tile's pixels, accordingly.
+                std::lock_guard<std::mutex> lock(tileMutexes[tile]);
+                status[tile] = DONE;
+                backups[tile].clear();
+            }
+            progress.update();
+
+            if(checkpointing && seconds_since(start) - lastCheckpoint >= checkpoint_interval_s && checkpointMutex.try_lock()){
+                if(seconds_since(start) - lastCheckpoint >= checkpoint_interval_s){
+                    if(!write_checkpoint(checkpoint_file(), header, pass, tiles, status, backups, tileMutexes))
+                        RT3_WARNING("Failed to save the checkpoint \"" + checkpoint_file() + "\".");
+                    lastCheckpoint = seconds_since(start);
+                }
+                checkpointMutex.unlock();
+            }
+
+            // Partial image, written by whichever thread gets here first once it is due.
+            if(progressive && seconds_since(start) - lastWrite >= flush_interval_s && writeMutex.try_lock()){
+                if(seconds_since(start) - lastWrite >= flush_interval_s){
+                    std::lock_guard<std::mutex> lock(filmMutex);
+                    camera->film->write_image();
+                    lastWrite = seconds_since(start);
+                }
+                writeMutex.unlock();
+            }
+        });
+        if(camera->film->has_filter()) resolve_tiles(tiles, nTilesX);
+        if(outOfTime) break;
+        ++donePasses;
+        std::fill(status.begin(), status.end(), PENDING);
+    }
+    progress.done();
+
+    // A render stopped by its time budget can be resumed later; a finished one needs no checkpoint.
+    if(outOfTime && checkpointing){
+        if(!write_checkpoint(checkpoint_file(), header, pass, tiles, status, backups, tileMutexes))
+            RT3_WARNING("Failed to save the checkpoint \"" + checkpoint_file() + "\".");
+    }else if(checkpointing || resume_render){
+        std::remove(checkpoint_file().c_str());
+    }
+
+    if(outOfTime){
+        RT3_MESSAGE("    Time budget reached after " + std::to_string(donePasses) + " full pass(es) ("
+            + std::to_string(donePasses > 0 ? passes[donePasses - 1] : 0) + " samples per pixel).");
+    }
+
     // send image color buffer to the output file.
     camera->film->write_image();
+    if(!sample_map_file.empty()) write_sample_map();
+}
+
+void SamplerIntegrator::render_streaming( const unique_ptr<Scene> &scene ) {
+    if(progressive) RT3_WARNING("Streaming output renders every tile in one go; progressive rendering and the time budget are off.");
+    if(!sample_map_file.empty()) RT3_WARNING("No sample map with streaming output.");
+    if(checkpoint_interval_s > 0 || resume_render) RT3_WARNING("Checkpoints are not supported with streaming output.");
+
+    int nTilesX;
+    int nTiles = tile_count(nTilesX);
+
+    // A tile only lives while it is rendered: the film memory is that of the tiles in flight.
+    camera->film->begin_stream(TILE_SIZE);
+    ProgressReporter progress(nTiles, show_progress);
+    parallel_for(nTiles, n_threads, [&](int tile, int /* worker */){
+        TileAccumulator pixels = tile_at(tile, nTilesX);
+        render_tile(scene, pixels);
+        pixels.flush(*camera->film);
+        progress.update();
+    });
+    progress.done();
+    camera->film->end_stream();
+}
+
+/*
+ * Protocol, after the coordinator and the worker have exchanged their RenderHeader
+ * (the worker adding its thread count): the coordinator sends batches of tile numbers
+ * (a count, then the numbers), and the worker answers each batch with its tiles, in
+ * the same order (number, size in bytes, TileAccumulator::save() data). A batch of 0
+ * tiles ends the render.
+ */
+void SamplerIntegrator::render_distributed( const unique_ptr<Scene> &scene ) {
+    if(progressive) RT3_WARNING("Distributed rendering renders every tile in one go; progressive rendering and the time budget are off.");
+    if(checkpoint_interval_s > 0 || resume_render) RT3_WARNING("Checkpoints are not supported with distributed rendering.");
+
+    int nTilesX;
+    const int nTiles = tile_count(nTilesX);
+    if(!sample_map_file.empty()) sampleCounts.assign(size_t(camera->film->crop_width()) * camera->film->crop_height(), 0);
+
+    vector<TileAccumulator> tiles;
+    tiles.reserve(nTiles);
+    for(int tile = 0; tile < nTiles; ++tile) tiles.push_back(tile_at(tile, nTilesX));
+
+    const RenderHeader header = render_header(*camera->film, scene_id, TILE_SIZE, nTiles, sampler->samples_per_pixel(),
+                                              1, adaptive_batch, adaptive_threshold);
+    std::atomic<int> nextTile{0};
+    vector<unsigned char> received(nTiles, 0);
+    ProgressReporter progress(nTiles, show_progress);
+
+    // One thread per worker, which keeps two batches in flight on it: while the worker renders
+    // one, the next is already waiting, so it does not sit idle on the network.
+    auto drive = [&](Connection &worker){
+        RenderHeader theirs;
+        int32_t threads = 0;
+        if(!worker.send_value(header) || !worker.receive_value(theirs) || !worker.receive_value(threads)){
+            RT3_WARNING("Lost " + worker.name + " before it started.");
+            return;
+        }
+        if(std::memcmp(&theirs, &header, sizeof(header)) != 0){
+            RT3_WARNING(worker.name + " has another scene, film or sampling settings; not using it.");
+            return;
+        }
+
+        const int batchSize = 2 * max(1, int(threads));
+        std::deque<vector<int32_t>> inFlight;
+        auto send_batch = [&](){
+            int first = nextTile.fetch_add(batchSize);
+            if(first >= nTiles) return true;
+            vector<int32_t> batch;
+            for(int tile = first; tile < min(first + batchSize, nTiles); ++tile) batch.push_back(tile);
+            inFlight.push_back(batch);
+            return worker.send_value(int32_t(batch.size())) && worker.send(batch.data(), batch.size() * sizeof(int32_t));
+        };
+
+        bool alive = send_batch() && send_batch();
+        string data;
+        while(alive && !inFlight.empty()){
+            for(int32_t expected : inFlight.front()){
+                int32_t tile;
+                uint32_t size;
+                alive = worker.receive_value(tile) && worker.receive_value(size)
+                     && tile == expected && size == tiles[tile].saved_size();
+                if(alive){
+                    data.resize(size);
+                    alive = worker.receive(&data[0], size);
+                }
+                if(!alive) break;
+                std::istringstream in(data);
+                tiles[tile].load(in);
+                flush_tile(tiles[tile]);
+                received[tile] = 1;
+                progress.update();
+            }
+            if(!alive) break;
+            inFlight.pop_front();
+            alive = send_batch();
+        }
+        if(alive) worker.send_value(int32_t(0));
+        else RT3_WARNING("Lost " + worker.name + "; its tiles are rendered here.");
+    };
+
+    vector<std::thread> drivers;
+    for(auto &worker : workers) drivers.emplace_back(drive, std::ref(*worker));
+    for(auto &t : drivers) t.join();
+    workers.clear(); // Also waits for the local workers to exit.
+
+    // Tiles no worker delivered: those of workers that failed, or all of them if none was usable.
+    vector<int> missing;
+    for(int tile = 0; tile < nTiles; ++tile) if(!received[tile]) missing.push_back(tile);
+    parallel_for(int(missing.size()), n_threads, [&](int k, int /* worker */){
+        render_tile(scene, tiles[missing[k]]);
+        flush_tile(tiles[missing[k]]);
+        progress.update();
+    });
+    progress.done();
+    if(!missing.empty()) RT3_MESSAGE("    " + std::to_string(missing.size()) + " of " + std::to_string(nTiles) + " tiles rendered locally.");
+
+    if(camera->film->has_filter()) resolve_tiles(tiles, nTilesX);
+    camera->film->write_image();
+    if(!sample_map_file.empty()) write_sample_map();
+}
+
+void SamplerIntegrator::serve( const unique_ptr<Scene> &scene, Connection &coordinator ) {
+    int nTilesX;
+    const int nTiles = tile_count(nTilesX);
+    const RenderHeader header = render_header(*camera->film, scene_id, TILE_SIZE, nTiles, sampler->samples_per_pixel(),
+                                              1, adaptive_batch, adaptive_threshold);
+
+    RenderHeader theirs;
+    if(!coordinator.receive_value(theirs) || !coordinator.send_value(header) || !coordinator.send_value(int32_t(n_threads)))
+        RT3_ERROR("Lost the coordinator.");
+    if(std::memcmp(&theirs, &header, sizeof(header)) != 0)
+        RT3_ERROR("The coordinator renders another scene, film or sampling settings.");
+
+    int served = 0;
+    vector<int32_t> batch;
+    std::ostringstream out;
+    for(;;){
+        int32_t count;
+        if(!coordinator.receive_value(count)) RT3_ERROR("Lost the coordinator.");
+        if(count <= 0) break;
+        batch.resize(count);
+        if(!coordinator.receive(batch.data(), batch.size() * sizeof(int32_t))) RT3_ERROR("Lost the coordinator.");
+        for(int32_t tile : batch) if(tile < 0 || tile >= nTiles) RT3_ERROR("The coordinator asked for an unknown tile.");
+
+        vector<TileAccumulator> tiles;
+        tiles.reserve(count);
+        for(int32_t tile : batch) tiles.push_back(tile_at(tile, nTilesX));
+        parallel_for(count, n_threads, [&](int k, int /* worker */){ render_tile(scene, tiles[k]); });
+
+        for(int k = 0; k < count; ++k){
+            out.str(string());
+            tiles[k].save(out);
+            const string &data = out.str();
+            if(!coordinator.send_value(batch[k]) || !coordinator.send_value(uint32_t(data.size()))
+               || !coordinator.send(data.data(), data.size()))
+                RT3_ERROR("Lost the coordinator.");
+        }
+        served += count;
+    }
+    RT3_MESSAGE("    Worker done: " + std::to_string(served) + " tiles rendered.");
+}
+
+int SamplerIntegrator::tile_count(int &nTilesX) const{
+    nTilesX = (camera->film->crop_width() + TILE_SIZE - 1) / TILE_SIZE;
+    int nTilesY = (camera->film->crop_height() + TILE_SIZE - 1) / TILE_SIZE;
+    return nTilesX * nTilesY;
+}
+
+TileAccumulator SamplerIntegrator::tile_at(int tile, int nTilesX) const{
+    const Point2i &begin = camera->film->crop_begin();
+    const Point2i &end = camera->film->crop_end();
+    int i0 = begin.at(0) + (tile / nTilesX) * TILE_SIZE;
+    int j0 = begin.at(1) + (tile % nTilesX) * TILE_SIZE;
+    return tile_accumulator(i0, min(i0 + TILE_SIZE, end.at(0)), j0, min(j0 + TILE_SIZE, end.at(1)));
+}
+
+void SamplerIntegrator::resolve_tiles(const vector<TileAccumulator> &tiles, int nTilesX) const{
+    const int nTilesY = int(tiles.size()) / nTilesX;
+    // Tiles away by this many tiles or fewer may have splatted into a tile's pixels.
+    const int reach = (camera->film->filter_margin() + TILE_SIZE - 1) / TILE_SIZE;
+
+    std::lock_guard<std::mutex> lock(filmMutex);
+    parallel_for(int(tiles.size()), n_threads, [&](int tile, int /* worker */){
+        int ty = tile / nTilesX, tx = tile % nTilesX;
+        vector<const FilmTile*> sources;
+        for(int y = max(0, ty - reach); y <= min(nTilesY - 1, ty + reach); ++y){
+            for(int x = max(0, tx - reach); x <= min(nTilesX - 1, tx + reach); ++x){
+                sources.push_back(tiles[size_t(y) * nTilesX + x].splats.get());
+            }
+        }
+        const TileAccumulator &own = tiles[tile];
+        camera->film->resolve(own.i0, own.i1, own.j0, own.j1, sources);
+    });
+}
+
+void SamplerIntegrator::write_sample_map() const{
+    auto w = camera->film->crop_width();
+    auto h = camera->film->crop_height();
+    int spp = sampler->samples_per_pixel();
+
+    vector<unsigned char> grey(size_t(w) * h * 3);
+    for(size_t p = 0; p < sampleCounts.size(); ++p){
+        unsigned char level = (255 * sampleCounts[p]) / spp;
+        grey[3 * p] = grey[3 * p + 1] = grey[3 * p + 2] = level;
+    }
+
+    if(!save_png(grey.data(), h, w, 3, sample_map_file, 6, n_threads)) RT3_ERROR("Failed to save the sample map.");
+    RT3_MESSAGE("    Sample map written to " + sample_map_file);
 }
 
 } // namespace rt3
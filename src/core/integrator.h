@@ -4,6 +4,10 @@
 #include "scene.h"
 #include "camera.h"
 #include "surfel.h"
+#include "sampler.h"
+#include "distributed.h"
+
+#include <mutex>
 
 
 namespace  rt3 {
@@ -12,6 +16,142 @@ class Integrator {
 public:
     virtual ~Integrator(){};
     virtual void render( const unique_ptr<Scene>& ) = 0;
+    /// Worker side of a distributed render: renders the tiles `coordinator` asks for and sends them back.
+    virtual void serve( const unique_ptr<Scene>&, Connection &coordinator ) = 0;
+
+    /// Number of worker threads used to render the image tiles.
+    void set_threads( int n ){ n_threads = std::max(1, n); }
+    /// Enables/disables the textual progress bar (e.g. when several frames render at once).
+    void set_progress_bar( bool show ){ show_progress = show; }
+    /// Renders in passes of increasing samples per pixel, writing the image between them
+    /// every `flush_interval` seconds at most, and stopping after `time_budget` seconds (0: none).
+    void set_progressive( bool enable, real_type time_budget, real_type flush_interval ){
+        progressive = enable || time_budget > 0;
+        time_budget_s = time_budget;
+        flush_interval_s = flush_interval;
+    }
+    /// Enables/disables tracing primary rays in packets (see RayPacket).
+    void set_packets( bool enable ){ use_packets = enable; }
+    /// Where the samples of each pixel go, and how many there are.
+    void set_sampler( unique_ptr<Sampler> &&s ){ sampler = std::move(s); }
+    /// Enables adaptive sampling: pixels stop once the standard error of their mean is below
+    /// `threshold` (0 disables it), checked every `batch` samples.
+    void set_adaptive( real_type threshold, int batch ){ adaptive_threshold = threshold; adaptive_batch = std::max(1, batch); }
+    /// Also writes an image of the samples taken per pixel (white: `spp`) to this file.
+    void set_sample_map( const string &filename ){ sample_map_file = filename; }
+    /// Saves the state of the render every `interval` seconds (0: never) next to the image, and
+    /// with `resume`, starts from the state saved by a previous run.
+    void set_checkpoint( real_type interval, bool resume ){ checkpoint_interval_s = interval; resume_render = resume; }
+    /// Identifies the scene (see scene_files_hash()), so checkpoints and workers of another scene are turned away.
+    void set_scene_id( uint32_t id ){ scene_id = id; }
+    /// Renders the tiles on these worker processes instead of on this one's threads.
+    void set_workers( vector<unique_ptr<Connection>> &&w ){ workers = std::move(w); }
+
+protected:
+    int n_threads = 1;
+    bool show_progress = true;
+    bool use_packets = true;
+    unique_ptr<Sampler> sampler = make_unique<CenterSampler>(1);
+    real_type adaptive_threshold = 0;
+    int adaptive_batch = 1;
+    string sample_map_file;
+    bool progressive = false;
+    real_type time_budget_s = 0;
+    real_type flush_interval_s = 1;
+    real_type checkpoint_interval_s = 0;
+    bool resume_render = false;
+    uint32_t scene_id = 0;
+    vector<unique_ptr<Connection>> workers;
+};
+
+
+/*!
+ * Running mean and variance (Welford) of the samples of a tile's pixels, averaged
+ * (box filter) into the film once the tile is done.
+ * It also decides when a pixel has enough samples: all `spp` of them, or, with
+ * adaptive sampling, as soon as the standard error of its mean falls below the
+ * threshold in every channel. That is checked once every `batch` samples only,
+ * so every way of rendering a tile stops a pixel after the same samples.
+ * A progressive render keeps the accumulator of every tile between passes, and
+ * raises the limit of samples per pixel after each pass.
+ * When the film has a reconstruction filter, the samples are also splatted into
+ * the tile's FilmTile, which the film is resolved from instead of the averages.
+ * When it has AOVs, the first hit of every sample is averaged as well (box filter).
+ */
+class TileAccumulator{
+private:
+    struct PixelStats{
+        int count = 0;
+        std::array<real_type, 3> mean{{0, 0, 0}};
+        std::array<real_type, 3> m2{{0, 0, 0}}; //!< Sum of squared deviations from the mean.
+    };
+    struct AovStats{
+        int samples = 0, hits = 0;
+        real_type depth = 0;                           //!< Sums over the hits.
+        std::array<real_type, 3> normal{{0, 0, 0}}, albedo{{0, 0, 0}};
+        int primitive = -1;                            //!< Hit by the first sample.
+    };
+
+    const int width;
+    const int spp, batch;
+    const real_type threshold; //!< Largest standard error accepted (0: no adaptive sampling).
+    int limit;                 //!< Samples per pixel allowed so far (at most spp).
+    vector<PixelStats> pixels;
+    vector<AovStats> aovs; //!< Empty unless the film has AOVs.
+
+    PixelStats & at(int i, int j){ return pixels[size_t(i - i0) * width + (j - j0)]; }
+    const PixelStats & at(int i, int j) const{ return pixels[size_t(i - i0) * width + (j - j0)]; }
+
+public:
+    const int i0, i1, j0, j1; //!< The tile: pixels [i0, i1) x [j0, j1).
+    unique_ptr<FilmTile> splats; //!< Filtered samples (nullptr without a filter).
+
+    TileAccumulator(int _i0, int _i1, int _j0, int _j1, int samples_per_pixel, real_type adaptive_threshold = 0, int adaptive_batch = 1):
+        width(_j1 - _j0), spp(samples_per_pixel), batch(std::max(1, adaptive_batch)),
+        threshold(adaptive_threshold), limit(samples_per_pixel), pixels(size_t(_i1 - _i0) * (_j1 - _j0)),
+        i0(_i0), i1(_i1), j0(_j0), j1(_j1){}
+
+    /// Caps the samples per pixel (for a progressive pass).
+    void set_limit(int n){ limit = min(n, spp); }
+    int sample_limit() const{ return limit; }
+
+    /// Adds the sample at `offset` (in [0,1)^2) inside pixel (i, j), of radiance `c`.
+    void add(int i, int j, const Point2f &offset, const Color &c){
+        if(splats) splats->add_sample(i, j, offset, c);
+        PixelStats &p = at(i, j);
+        ++p.count;
+        for(int k = 0; k < 3; ++k){
+            real_type delta = c.at(k) - p.mean[k];
+            p.mean[k] += delta / p.count;
+            p.m2[k] += delta * (c.at(k) - p.mean[k]);
+        }
+    }
+
+    /// Also averages the first hits of the samples (see add_aov()).
+    void enable_aovs(){ aovs.assign(pixels.size(), AovStats{}); }
+    bool has_aovs() const{ return !aovs.empty(); }
+    /// Adds the first hit of a sample of pixel (i, j), in sample order (`isect` is nullptr if it missed),
+    /// with the albedo of its material.
+    void add_aov(int i, int j, const ObjSurfel *isect, const Color &albedo);
+
+    /// Raw copy of the samples so far (statistics, splats and AOVs), for checkpoints and workers.
+    void save(std::ostream &out) const;
+    /// Bytes save() writes.
+    size_t saved_size() const{
+        return pixels.size() * sizeof(PixelStats) + (splats ? splats->saved_size() : 0) + aovs.size() * sizeof(AovStats);
+    }
+    /// Restores what save() wrote; false if the data does not fit this tile.
+    bool load(std::istream &in);
+
+    /// Samples taken so far in pixel (i, j); also the index of its next sample.
+    int count(int i, int j) const{ return at(i, j).count; }
+    /// Whether pixel (i, j) should take another sample.
+    bool needs_samples(int i, int j) const;
+
+    /// Writes the average of every pixel to the film (unless filtered), its AOVs, and its sample count
+    /// to `counts` (the whole crop window, row by row; nullptr if not wanted).
+    /// A streaming film gets the tile written to its file instead.
+    void flush(Film &film, vector<int> *counts = nullptr) const;
 };
 
 
@@ -25,13 +165,63 @@ public:
         camera = std::move(_camera);
     }
 
-    virtual Color Li(const Ray&, const unique_ptr<Scene>&, const Color) const = 0;
+    /// Radiance along the ray given its first hit (`isect` is nullptr when the ray escapes).
+    /// Any random choice draws from `rng`, the stream of the ray's pixel sample.
+    virtual Color shade(const Ray&, const shared_ptr<ObjSurfel>& isect, const unique_ptr<Scene>&, const Color, RandomStream &rng) const = 0;
     virtual void render( const unique_ptr<Scene>& );
+    virtual void serve( const unique_ptr<Scene>&, Connection &coordinator );
     // virtual void preprocess( const unique_ptr<Scene>& );
     
 protected:
+    /// Side, in pixels, of the square tiles the image is split into.
+    static const int TILE_SIZE = 16;
+
     std::unique_ptr<Camera> camera;
+    mutable vector<int> sampleCounts; //!< Samples per pixel, kept when a sample map is asked for.
+    mutable std::mutex filmMutex;     //!< Tiles reach the film while a partial image may be written.
     int getColorFromCoord(real_type x) const;
+
+    /// The square tiles (row-major, `nTilesX` of them per row) covering the crop window.
+    int tile_count(int &nTilesX) const;
+    /// Accumulator for tile number `tile` of that grid.
+    TileAccumulator tile_at(int tile, int nTilesX) const;
+    /// Accumulator for a tile, set up with the sampling options.
+    TileAccumulator tile_accumulator(int i0, int i1, int j0, int j1) const{
+        TileAccumulator pixels(i0, i1, j0, j1, sampler->samples_per_pixel(), adaptive_threshold, adaptive_batch);
+        if(camera->film->has_filter()) pixels.splats = camera->film->film_tile(i0, i1, j0, j1);
+        if(camera->film->has_aovs()) pixels.enable_aovs();
+        return pixels;
+    }
+    /// Hands the accumulated tile to the film (and to the sample map).
+    void flush_tile(const TileAccumulator &pixels) const{
+        std::lock_guard<std::mutex> lock(filmMutex);
+        pixels.flush(*camera->film, sample_map_file.empty() ? nullptr : &sampleCounts);
+    }
+    void write_sample_map() const;
+    /// Where checkpoints go: next to the image.
+    string checkpoint_file() const{ return camera->film->m_filename + ".ckpt"; }
+    /// Single pass render for a streaming film: each tile goes to the file once done.
+    void render_streaming(const unique_ptr<Scene>&);
+    /// Single pass render whose tiles are rendered by the workers (and here, for those a worker dropped).
+    void render_distributed(const unique_ptr<Scene>&);
+    /// Film pixels from the splats of `tiles` (a row-major grid, `nTilesX` wide), each pixel summing the
+    /// tiles that reach it in tile order, so the image does not depend on which thread rendered what.
+    void resolve_tiles(const vector<TileAccumulator> &tiles, int nTilesX) const;
+
+    Color background_at(const unique_ptr<Scene>&, int i, int j) const;
+    /// Adds the first hit of a sample of pixel (i, j) to the AOVs of `pixels`.
+    void add_aov(const unique_ptr<Scene>&, TileAccumulator &pixels, int i, int j, const shared_ptr<ObjSurfel> &isect) const;
+    /// Film position of the sample at `offset` (in [0,1)^2) inside pixel (i, j).
+    static Point2f film_position(int i, int j, const Point2f &offset){
+        return Point2f{{i + offset.at(0), j + offset.at(1)}};
+    }
+    /// Adds to the tile of `pixels` the samples its pixels still need (up to the pass limit).
+    virtual void render_tile(const unique_ptr<Scene>&, TileAccumulator &pixels) const;
+    /// Renders a tile one ray at a time, every sample of a pixel in a row.
+    void render_block(const unique_ptr<Scene>&, TileAccumulator &pixels) const;
+    /// Same as render_block(), but the first hits are found WIDTH x WIDTH rays at a time
+    /// (the same sample of WIDTH x WIDTH neighbouring pixels).
+    void render_block_packets(const unique_ptr<Scene>&, TileAccumulator &pixels) const;
 };
 
 
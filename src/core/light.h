@@ -2,6 +2,7 @@
 #define LIGHT_H
 
 #include "rt3-base.h"
+#include "stats.h"
 
 namespace rt3{
 // Verifica se há oclusão entre dois pontos de contato.
@@ -14,20 +15,34 @@ public:
     VisibilityTester(const shared_ptr<Surfel>& obj, const shared_ptr<Surfel>& light):
         objectContact(obj), lightContact(light){}
 
+    /// Ray from the light towards the object, and how far it may go before hitting it.
+    Ray shadow_ray() const{ return Ray(lightContact->p, lightContact->wo); }
+    real_type shadow_max_t() const{ return lightContact->t - ray_offset(objectContact->p, lightContact->t); }
+
     // vai iterar por todos objs ta cena vendo se tem contato
     bool unoccluded(const unique_ptr<Scene>& scene){
-        Ray lightRay = Ray(lightContact->p, lightContact->wo);
-        return not scene->intersect_p(lightRay, lightContact->t - EPS);
+        return not scene->intersect_p(shadow_ray(), shadow_max_t());
     }
 };
 
+/// Where a light is and where it shines, for lights that have a position.
+struct LightBounds{
+    Point3f position;
+    Vector3f axis;
+    real_type thetaE; //!< Half-angle of the emission cone around `axis` (PI: every direction).
+};
+
 class Light {  
 public:
     Color colorIntensity;
     Vector3f scale;
+    /// Counts the shadow rays skipped because this light could not contribute (may be nullptr).
+    StatCounter *shadowRaysAvoided = nullptr;
     
     Light(const Color &c, const Vector3f &scl):colorIntensity(c), scale(scl){};
     virtual void preprocess( const Scene & ) = 0;
+    /// Fills `b` and returns true if the light has a position (see LightBVH).
+    virtual bool bounds( LightBounds &b ) const { return false; }
 
     virtual ~Light(){};
 };
@@ -0,0 +1,184 @@
+#include "light_bvh.h"
+#include "light.h"
+#include "rng.h"
+
+namespace rt3{
+
+namespace{
+
+// Angles are compared with this much slack, so rounding never prunes a light
+// the exact test in Light::Li() would keep.
+const real_type ANGLE_SLACK = 1e-3;
+
+real_type safe_acos(real_type x){
+    return acos(Clamp<real_type, real_type, real_type>(x, -1, 1));
+}
+
+/// Rotates `v` around the unit axis `k` by `theta` (Rodrigues).
+Vector3f rotate(const Vector3f &v, const Vector3f &k, real_type theta){
+    return v * cos(theta) + k.cross(v) * sin(theta) + k * ((k * v) * (1 - cos(theta)));
+}
+
+/// Smallest cone (axis, spread) holding both cones.
+void cone_union(Vector3f &axisA, real_type &thetaA, const Vector3f &axisB, real_type thetaB){
+    real_type thetaD = safe_acos(axisA * axisB);
+    if(min(thetaD + thetaB, real_type(M_PI)) <= thetaA) return;
+    if(min(thetaD + thetaA, real_type(M_PI)) <= thetaB){
+        axisA = axisB;
+        thetaA = thetaB;
+        return;
+    }
+
+    real_type thetaO = (thetaA + thetaD + thetaB) / 2;
+    Vector3f k = axisA.cross(axisB);
+    if(thetaO >= M_PI || k.getNorm() == 0){
+        thetaA = M_PI;
+        return;
+    }
+    axisA = rotate(axisA, k.normalize(), thetaO - thetaA).normalize();
+    thetaA = thetaO;
+}
+
+} // namespace
+
+LightBVH::LightBVH(const vector<shared_ptr<Light>> &lights){
+    vector<Node> leaves;
+    for(int l = 0; l < int(lights.size()); ++l){
+        LightBounds b;
+        if(!lights[l]->bounds(b)){
+            outside.push_back(l);
+            continue;
+        }
+
+        const Color &I = lights[l]->colorIntensity;
+        Node leaf;
+        leaf.box = Bounds3f(b.position, b.position);
+        leaf.intensity = leaf.power = max(I.at(0), max(I.at(1), I.at(2)));
+        leaf.axis = b.axis;
+        leaf.thetaO = 0;
+        leaf.thetaE = b.thetaE;
+        leaf.light = l;
+        leaves.push_back(leaf);
+    }
+
+    if(!leaves.empty()) build(leaves, 0, leaves.size());
+}
+
+int LightBVH::build(vector<Node> &leaves, int begin, int end){
+    if(end - begin == 1){
+        nodes.push_back(leaves[begin]);
+        return nodes.size() - 1;
+    }
+
+    // Median split along the widest axis of the light positions.
+    Bounds3f box = leaves[begin].box;
+    for(int i = begin + 1; i < end; ++i) box = Bounds3f::unite(box, leaves[i].box);
+
+    int axis = 0;
+    for(int a = 1; a < 3; ++a){
+        if(box.maxPoint.at(a) - box.minPoint.at(a) > box.maxPoint.at(axis) - box.minPoint.at(axis)) axis = a;
+    }
+    int mid = (begin + end) / 2;
+    std::nth_element(leaves.begin() + begin, leaves.begin() + mid, leaves.begin() + end,
+        [axis](const Node &a, const Node &b){ return a.box.minPoint.at(axis) < b.box.minPoint.at(axis); });
+
+    int index = nodes.size();
+    nodes.push_back(Node());
+    int left = build(leaves, begin, mid);
+    int right = build(leaves, mid, end);
+
+    Node &node = nodes[index];
+    const Node &a = nodes[left], &b = nodes[right];
+    node.box = Bounds3f::unite(a.box, b.box);
+    node.intensity = max(a.intensity, b.intensity);
+    node.power = a.power + b.power;
+    node.axis = a.axis;
+    node.thetaO = a.thetaO;
+    cone_union(node.axis, node.thetaO, b.axis, b.thetaO);
+    node.thetaE = max(a.thetaE, b.thetaE);
+    node.children[0] = left;
+    node.children[1] = right;
+    return index;
+}
+
+real_type LightBVH::bound(const Node &node, real_type weight, const Point3f &p, const Normal3f &n,
+        real_type diffuse, real_type specular) const{
+    // The node's lights, seen from p, are within `thetaB` of the direction to the box center.
+    Point3f center = (node.box.minPoint + node.box.maxPoint) * real_type(0.5);
+    real_type radius = (node.box.maxPoint - center).getNorm();
+    Vector3f toPoint = p - center;
+    real_type dist = toPoint.getNorm();
+
+    real_type cosBound = 1;
+    if(dist > radius){
+        Vector3f wi = toPoint * (1 / dist); // from the lights to p
+        real_type thetaB = asin(radius / dist);
+
+        // Emission cone: p must be within thetaE of some light axis.
+        if(node.thetaO + node.thetaE < M_PI){
+            real_type theta = max(real_type(0), safe_acos(node.axis * wi) - node.thetaO - thetaB);
+            if(theta > node.thetaE + ANGLE_SLACK) return 0;
+        }
+
+        // Lights behind the surface add nothing.
+        real_type thetaI = max(real_type(0), safe_acos(n * (wi * -1)) - thetaB);
+        if(thetaI > M_PI / 2 + ANGLE_SLACK) return 0;
+        cosBound = max(real_type(0), real_type(cos(thetaI)));
+    }
+
+    return weight * (diffuse * cosBound + specular);
+}
+
+void LightBVH::prune(const Point3f &p, const Normal3f &n, real_type diffuse, real_type specular,
+        real_type threshold, vector<int> &lights) const{
+    lights.clear();
+    if(empty()) return;
+    prune(0, p, n, diffuse, specular, threshold, lights);
+    sort(lights.begin(), lights.end());
+}
+
+void LightBVH::prune(int index, const Point3f &p, const Normal3f &n, real_type diffuse, real_type specular,
+        real_type threshold, vector<int> &lights) const{
+    const Node &node = nodes[index];
+    if(bound(node, node.intensity, p, n, diffuse, specular) <= threshold) return;
+
+    if(node.light >= 0){
+        lights.push_back(node.light);
+    }else{
+        prune(node.children[0], p, n, diffuse, specular, threshold, lights);
+        prune(node.children[1], p, n, diffuse, specular, threshold, lights);
+    }
+}
+
+int LightBVH::sample(const Point3f &p, const Normal3f &n, real_type diffuse, real_type specular,
+        real_type u, real_type &pdf) const{
+    pdf = 1;
+    if(empty()) return -1;
+
+    int index = 0;
+    if(bound(nodes[0], nodes[0].power, p, n, diffuse, specular) <= 0) return -1;
+
+    while(nodes[index].light < 0){
+        const Node &node = nodes[index];
+        real_type w[2];
+        for(int c = 0; c < 2; ++c){
+            const Node &child = nodes[node.children[c]];
+            w[c] = bound(child, child.power, p, n, diffuse, specular);
+        }
+        if(w[0] + w[1] <= 0) return -1;
+
+        real_type p0 = w[0] / (w[0] + w[1]);
+        if(u < p0){
+            u = min(u / p0, ONE_MINUS_EPSILON);
+            pdf *= p0;
+            index = node.children[0];
+        }else{
+            u = min((u - p0) / (1 - p0), ONE_MINUS_EPSILON);
+            pdf *= 1 - p0;
+            index = node.children[1];
+        }
+    }
+    return nodes[index].light;
+}
+
+} // namespace rt3
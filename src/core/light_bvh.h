@@ -0,0 +1,59 @@
+#ifndef LIGHT_BVH_H
+#define LIGHT_BVH_H
+
+#include "rt3.h"
+#include "bounds.h"
+
+namespace rt3{
+
+/*!
+ * Hierarchy over the lights that have a position (point and spot lights).
+ * Every node keeps the box around its lights, their intensity and the cone of
+ * directions they emit in, which bounds what the whole subtree can add at a
+ * shading point. Lights without a position (ambient, directional) stay outside.
+ */
+class LightBVH{
+private:
+    struct Node{
+        Bounds3f box;
+        real_type intensity = 0; //!< Strongest channel of the strongest light.
+        real_type power = 0;     //!< Sum of the strongest channel of every light.
+        Vector3f axis;           //!< Emission cone: axis,
+        real_type thetaO = 0;    //!< spread of the light axes around it,
+        real_type thetaE = 0;    //!< and how far from its own axis each light emits (radians).
+        int children[2] = {-1, -1};
+        int light = -1;          //!< Index in the scene lights (leaves only).
+    };
+
+    vector<Node> nodes;
+    vector<int> outside; //!< Lights not in the tree, in scene order.
+
+    int build(vector<Node> &leaves, int begin, int end);
+    /// Upper bound on the (per channel) contribution of a node at a shading point.
+    real_type bound(const Node &node, real_type weight, const Point3f &p, const Normal3f &n,
+        real_type diffuse, real_type specular) const;
+    void prune(int node, const Point3f &p, const Normal3f &n, real_type diffuse, real_type specular,
+        real_type threshold, vector<int> &lights) const;
+
+public:
+    LightBVH(const vector<shared_ptr<Light>> &lights);
+
+    bool empty() const { return nodes.empty(); }
+    const vector<int> &unbounded() const { return outside; }
+
+    /*!
+     * Lights of the tree whose contribution at (p, n) may exceed `threshold`, in scene order.
+     * `diffuse` and `specular` bound the surface reflectance (strongest channel).
+     */
+    void prune(const Point3f &p, const Normal3f &n, real_type diffuse, real_type specular,
+        real_type threshold, vector<int> &lights) const;
+
+    /// Picks a light of the tree with probability proportional to its bounded contribution,
+    /// using the uniform number `u`. Returns -1 when no light can contribute.
+    int sample(const Point3f &p, const Normal3f &n, real_type diffuse, real_type specular,
+        real_type u, real_type &pdf) const;
+};
+
+} // namespace rt3
+
+#endif
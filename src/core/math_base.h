@@ -22,7 +22,13 @@ using std::swap;
 namespace rt3{
 
 //=== aliases
+// Floating point type of the whole renderer: float, or double when built with RT3_REAL_DOUBLE
+// (the basic_rt3_f64 target), for scenes too large for float precision.
+#if defined(RT3_REAL_DOUBLE)
+typedef double real_type;
+#else
 typedef float real_type;
+#endif
 typedef size_t size_type;
 typedef std::tuple<bool, std::string> result_type;
 
@@ -33,8 +39,8 @@ typedef std::tuple<bool, std::string> result_type;
  * \return The interpolated value.
  */
 //
-inline float Lerp(float t, float v1, float v2) {
-  return (1.f - t) * v1 + t * v2;
+inline real_type Lerp(real_type t, real_type v1, real_type v2) {
+  return (1 - t) * v1 + t * v2;
 }
 
 /// Clamp T to [low,high].
@@ -3,16 +3,25 @@
 
 #include "math_base.h"
 #include "matrix.h"
+#include "simd.h"
+
+#include <initializer_list>
+#include <type_traits>
 
 namespace rt3{
 
+/// Whether StructuredValues<T, size> is laid out as a Float4: 16-byte aligned, with a
+/// fourth, padding lane (0 unless an operation makes it something else; it is never read back).
+template <typename T, int size>
+constexpr bool simd_layout = std::is_same<T, float>::value && size == 3;
+
 // wrapper class for structured point values
 template <typename T, int size> class StructuredValues {
 protected:
-  array<T, size> values;
+  alignas(simd_layout<T, size> ? 16 : alignof(T)) array<T, simd_layout<T, size> ? 4 : size> values{};
 
 public:
-  StructuredValues(){ values = array<T,size>();}
+  StructuredValues(){}
   StructuredValues(const StructuredValues &clone) = default;
 
   template <typename _T, int _size>
@@ -20,10 +29,20 @@ public:
 
 
   StructuredValues(const vector<T> &_values){
-    assert(values.size() == size);
+    assert(_values.size() <= size_t(size));
     copy_n(_values.begin(), _values.size(), values.begin());
   }  
 
+  /// Same as from a vector, without allocating one (e.g. `Color({1, 0, 0})`).
+  StructuredValues(std::initializer_list<T> _values){
+    assert(_values.size() <= size_t(size));
+    copy_n(_values.begin(), _values.size(), values.begin());
+  }
+
+  /// The values as Float4 lanes (only with simd_layout).
+  Float4 lanes() const{ return Float4::load(values.data()); }
+  void set_lanes(const Float4 &v){ v.store(values.data()); }
+
   T& operator[]( const int i ){
     assert(i < size);
     return values[i];
@@ -36,7 +55,11 @@ public:
 
   StructuredValues operator*(real_type t) const{
       StructuredValues v(*this);
-      for(auto &x : v.values) x *= t;
+      if constexpr (simd_layout<T, size>){
+        v.set_lanes(lanes() * Float4::broadcast(t));
+      }else{
+        for(auto &x : v.values) x *= t;
+      }
       return v;
   }
 
@@ -70,6 +93,7 @@ template<typename T, int size> struct Vector :
   Vector():StructuredValues<T,size>(){}
   Vector(const Vector &clone):StructuredValues<T,size>(clone){}
   Vector(const vector<T> &_values):StructuredValues<T,size>(_values){}
+  Vector(std::initializer_list<T> _values):StructuredValues<T,size>(_values){}
 
   Vector(StructuredValues<T,size> base):StructuredValues<T,size>(base){}
     
@@ -78,6 +102,7 @@ template<typename T, int size> struct Vector :
   }
 
   real_type operator*(const Vector &u) const{
+    if constexpr (simd_layout<T, size>) return dot3(this->lanes(), u.lanes());
     real_type prod = 0;
     for(int i = 0; i < size; ++i){
       prod += this->at(i) * u.at(i);
@@ -88,11 +113,20 @@ template<typename T, int size> struct Vector :
   Vector normalize() const{
     Vector v(*this);
     real_type norm = v.getNorm();
+    if constexpr (simd_layout<T, size>){
+      // Exact square root and division: hardware reciprocal estimates differ between CPUs.
+      v.set_lanes(this->lanes() * Float4::broadcast(1 / norm));
+      return v;
+    }
     return v * (1.0 / norm);
   }
 
   Vector abs() const{
     Vector v(*this);
+    if constexpr (simd_layout<T, size>){
+      v.set_lanes(fabs(this->lanes()));
+      return v;
+    }
     for(int i = 0; i < size; ++i){
       v[i] = fabs(v[i]);
     }
@@ -101,6 +135,10 @@ template<typename T, int size> struct Vector :
 
   Vector cross(const Vector &x) const{
     Vector v(*this);
+    if constexpr (simd_layout<T, size>){
+      v.set_lanes(cross3(this->lanes(), x.lanes()));
+      return v;
+    }
     v[0] = this->at(1) * x.at(2) - this->at(2) * x.at(1);
     v[1] = this->at(2) * x.at(0) - this->at(0) * x.at(2);
     v[2] = this->at(0) * x.at(1) - this->at(1) * x.at(0);
@@ -108,6 +146,7 @@ template<typename T, int size> struct Vector :
   }
 
   real_type getNorm() const{
+    if constexpr (simd_layout<T, size>) return sqrt(dot3(this->lanes(), this->lanes()));
     real_type norm = 0;
     for(auto x : values){
       norm += x * x;
@@ -125,6 +164,7 @@ template<typename T, int size> struct Point :
   Point():StructuredValues<T,size>(){}
   Point(const Point &clone):StructuredValues<T,size>(clone){}
   Point(const vector<T> &_values):StructuredValues<T,size>(_values){}
+  Point(std::initializer_list<T> _values):StructuredValues<T,size>(_values){}
   Point(StructuredValues<T,size> base):StructuredValues<T,size>(base){}
 
   Point operator*(real_type t) const{
@@ -137,6 +177,10 @@ template<typename T, int size> struct Point :
 template<typename T, int size>
 Vector<T,size> operator-(const Point<T,size>& x, const Point<T,size>& y){
     Vector<T,size> v;
+    if constexpr (simd_layout<T, size>){
+      v.set_lanes(x.lanes() - y.lanes());
+      return v;
+    }
     for(int i = 0; i < size; ++i){
       v[i] = x.at(i) - y.at(i);
     }
@@ -148,6 +192,10 @@ Vector<T,size> operator-(const Point<T,size>& x, const Point<T,size>& y){
 template<typename T, int size>
 Point<T, size> operator+(const Point<T, size> x, const Vector<T,size> y){
     Point<T, size> v(x);
+    if constexpr (simd_layout<T, size>){
+      v.set_lanes(x.lanes() + y.lanes());
+      return v;
+    }
     for(int i = 0; i < size; ++i){
         v[i] += y.at(i);
     }
@@ -158,6 +206,10 @@ Point<T, size> operator+(const Point<T, size> x, const Vector<T,size> y){
 template<typename T, int size>
 Point<T, size> operator+(const Point<T, size> x, const Point<T,size> y){
     Point<T, size> v(x);
+    if constexpr (simd_layout<T, size>){
+      v.set_lanes(x.lanes() + y.lanes());
+      return v;
+    }
     for(int i = 0; i < size; ++i){
         v[i] += y.at(i);
     }
@@ -169,6 +221,10 @@ Point<T, size> operator+(const Point<T, size> x, const Point<T,size> y){
 template<typename T, int size>
 Vector<T, size> operator+(const Vector<T, size> &x, const Vector<T,size> &y){
     Vector<T, size> v;
+    if constexpr (simd_layout<T, size>){
+      v.set_lanes(x.lanes() + y.lanes());
+      return v;
+    }
     for(int i = 0; i < size; ++i){
         v[i] = x.at(i) + y.at(i);
     }
@@ -194,6 +250,7 @@ class Normal3f : public Vector3f {
 public:
   Normal3f():Vector3f(){}
   Normal3f(const vector<real_type> &_values):Vector3f(_values){}
+  Normal3f(std::initializer_list<real_type> _values):Vector3f(_values){}
   Normal3f(Vector3f base):Vector3f(base){}
 
 };
@@ -0,0 +1,68 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace rt3{
+
+int num_system_cores(){
+    return std::max(1, int(std::thread::hardware_concurrency()));
+}
+
+int resolve_thread_count(int requested){
+    return requested > 0 ? requested : num_system_cores();
+}
+
+void parallel_for(int count, int nWorkers, const std::function<void(int, int)> &func){
+    nWorkers = std::max(1, std::min(nWorkers, count));
+
+    // No point in spawning threads for a single worker.
+    if(nWorkers == 1){
+        for(int task = 0; task < count; ++task) func(task, 0);
+        return;
+    }
+
+    std::atomic<int> nextTask{0};
+    auto workerLoop = [&](int worker){
+        int task;
+        while((task = nextTask.fetch_add(1)) < count){
+            func(task, worker);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for(int w = 1; w < nWorkers; ++w){
+        workers.emplace_back(workerLoop, w);
+    }
+    workerLoop(0);
+
+    for(auto &t : workers) t.join();
+}
+
+ProgressReporter::ProgressReporter(int total, bool show):
+    totalTasks(std::max(1, total)), enabled(show){
+    if(enabled){
+        std::cout << "[ ";
+        std::cout.flush();
+    }
+}
+
+void ProgressReporter::update(){
+    int finished = ++finishedTasks;
+    if(!enabled) return;
+
+    int steps = (finished * numberSteps) / totalTasks;
+    std::lock_guard<std::mutex> lock(printMutex);
+    for(; printedSteps < steps; ++printedSteps){
+        std::cout << "\b=>";
+    }
+    std::cout.flush();
+}
+
+void ProgressReporter::done(){
+    if(enabled) std::cout << "]\n";
+}
+
+} // namespace rt3
@@ -0,0 +1,44 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+
+namespace rt3{
+
+/// Number of hardware threads available (at least 1).
+int num_system_cores();
+
+/// Resolves a requested thread count; values <= 0 mean "use every core".
+int resolve_thread_count(int requested);
+
+/*!
+ * Runs `func(task, worker)` for every task in [0, count).
+ * Tasks are handed out in increasing order from a shared counter to `nWorkers`
+ * threads, so the calling thread blocks until every task is done.
+ * `worker` is in [0, nWorkers) and can be used to index per-thread scratch data.
+ */
+void parallel_for(int count, int nWorkers, const std::function<void(int, int)> &func);
+
+/// Thread-safe textual progress bar, advanced once per finished task.
+class ProgressReporter{
+private:
+    static const int numberSteps = 50;
+
+    const int totalTasks;
+    const bool enabled;
+    std::atomic<int> finishedTasks{0};
+    std::mutex printMutex;
+    int printedSteps = 0;
+
+public:
+    ProgressReporter(int total, bool show = true);
+
+    void update();
+    void done();
+};
+
+} // namespace rt3
+
+#endif
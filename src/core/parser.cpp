@@ -5,6 +5,7 @@
 
 #include "parser.h"
 #include "../api/api.h"
+#include "distributed.h"
 #include "paramset.h"
 #include "rt3.h"
 
@@ -62,6 +63,21 @@ void parse_enum_attrib(stringstream &ss, ParamSet *ps_out, const string &name,
   RT3_ERROR("Couldn't match Enum.");
 }
 
+/// A list of enum values, given by name.
+template <typename T>
+void parse_enum_list_attrib(stringstream &ss, ParamSet *ps_out, const string &name,
+                            const vector<string> &names_list) {
+  vector<T> values;
+  string val;
+  while (ss >> val) {
+    auto found = std::find(names_list.begin(), names_list.end(), val);
+    if (found == names_list.end())
+      RT3_ERROR("Couldn't match Enum \"" + val + "\".");
+    values.push_back(T(found - names_list.begin()));
+  }
+  (*ps_out)[name] = make_shared<Value<vector<T>>>(Value<vector<T>>(values));
+}
+
 template <typename T>
 void parse_single_prim_attrib(stringstream &ss, ParamSet *ps_out,
                               const string &name) {
@@ -146,7 +162,14 @@ void parse_ptr_array_prim_attrib(stringstream &ss, ParamSet *ps_out,
       make_shared<Value<final_type>>(value);
 }
 
-/// This is the entry function for the parsing process.
+namespace {
+/// Running hash of the files parse() has loaded, in the order it loaded them.
+uint32_t files_hash = FNV_OFFSET_BASIS;
+} // namespace
+
+uint32_t scene_files_hash() { return files_hash; }
+
+/// This is the entry function for the parsing process (also for included files).
 void parse(const char *scene_file_name) {
   tinyxml2::XMLDocument xml_doc;
 
@@ -155,6 +178,7 @@ void parse(const char *scene_file_name) {
     RT3_ERROR(std::string{"The file \""} + scene_file_name +
               std::string{"\" either is not available OR contains an invalid "
                           "RT3 scene provided!"});
+  files_hash = file_hash(scene_file_name, files_hash);
 
   // ===============================================
   // Get a pointer to the document's root node.
@@ -213,9 +237,20 @@ void parse_tags(tinyxml2::XMLElement *p_element, int level) {
           {param_type_e::STRING, "type"},
           {param_type_e::STRING, "filename"},
           {param_type_e::IMAGE_TYPE, "img_type"},
+          {param_type_e::BOOL, "exr_half"},
+          {param_type_e::EXR_COMPRESSION, "exr_compression"},
+          {param_type_e::INT, "png_compression"},
           {param_type_e::INT, "x_res"},
           {param_type_e::INT, "y_res"},
           {param_type_e::ARR_REAL, "crop_window"},
+          {param_type_e::BOOL, "crop_composite"},
+          {param_type_e::BOOL, "streaming"},
+          {param_type_e::AOV_LIST, "aovs"},
+          {param_type_e::FILTER_TYPE, "filter"},
+          {param_type_e::REAL, "filter_radius"},
+          {param_type_e::REAL, "filter_alpha"},
+          {param_type_e::REAL, "mitchell_b"},
+          {param_type_e::REAL, "mitchell_c"},
           {param_type_e::STRING, "gamma_corrected"} // bool
       };
       parse_parameters(p_element, param_list, /* out */ &ps);
@@ -325,14 +360,49 @@ void parse_tags(tinyxml2::XMLElement *p_element, int level) {
       parse_parameters(p_element, param_list, &ps);
 
       API::lookat(ps);
+    } else if (tag_name == "animation") {
+      ParamSet ps;
+
+      vector<std::pair<param_type_e, string>> param_list{
+          {param_type_e::INT, "frames"},
+          {param_type_e::INT, "frame_threads"}, // frames rendered at the same time
+          {param_type_e::INTERPOLATION_TYPE, "interpolation"},
+      };
+      parse_parameters(p_element, param_list, &ps);
+
+      API::animation(ps);
+    } else if (tag_name == "keyframe") {
+      ParamSet ps;
+
+      vector<std::pair<param_type_e, string>> param_list{
+          {param_type_e::INT, "frame"},
+          {param_type_e::POINT3F, "look_from"},
+          {param_type_e::POINT3F, "look_at"},
+          {param_type_e::VEC3F, "up"},
+      };
+      parse_parameters(p_element, param_list, &ps);
+
+      API::keyframe(ps);
     } else if (tag_name == "integrator") {
       ParamSet ps;
 
       vector<std::pair<param_type_e, string>> param_list{
           {param_type_e::INTEGRATOR_TYPE, "type"},
+          {param_type_e::BOOL, "packets"},
+          {param_type_e::INT, "spp"},
+          {param_type_e::SAMPLER_TYPE, "sampler"},
+          {param_type_e::REAL, "adaptive_threshold"},
+          {param_type_e::INT, "min_spp"},
+          {param_type_e::STRING, "sample_map"},
 
           // Blinn Phong
           {param_type_e::INT, "depth"},
+          {param_type_e::BOOL, "wavefront"},
+          {param_type_e::REAL, "shadow_cutoff"},
+          {param_type_e::LIGHT_SELECTION_TYPE, "light_selection"},
+          {param_type_e::INT, "light_samples"},
+          {param_type_e::REAL, "min_throughput"},
+          {param_type_e::INT, "rr_depth"},
 
           // Depth map integrator
           {param_type_e::REAL, "zmin"},
@@ -561,9 +631,32 @@ void parse_parameters(tinyxml2::XMLElement *p_element,
       case param_type_e::LIGHT_TYPE:
         parse_enum_attrib<light_type_t>(ss, ps_out, name, light_type_t_names);
         break;
+      case param_type_e::INTERPOLATION_TYPE:
+        parse_enum_attrib<interpolation_type_t>(ss, ps_out, name,
+                                                interpolation_type_t_names);
+        break;
+      case param_type_e::LIGHT_SELECTION_TYPE:
+        parse_enum_attrib<light_selection_t>(ss, ps_out, name,
+                                             light_selection_t_names);
+        break;
+      case param_type_e::SAMPLER_TYPE:
+        parse_enum_attrib<sampler_type_t>(ss, ps_out, name,
+                                          sampler_type_t_names);
+        break;
+      case param_type_e::FILTER_TYPE:
+        parse_enum_attrib<filter_type_t>(ss, ps_out, name,
+                                         filter_type_t_names);
+        break;
+      case param_type_e::EXR_COMPRESSION:
+        parse_enum_attrib<exr_compression_t>(ss, ps_out, name,
+                                             exr_compression_t_names);
+        break;
+      case param_type_e::AOV_LIST:
+        parse_enum_list_attrib<aov_type_t>(ss, ps_out, name, aov_type_t_names);
+        break;
       // COMPOSITES
       case param_type_e::VEC3F:
-        parse_single_composite_attrib<float, Vector3f, int(3)>(ss, ps_out,
+        parse_single_composite_attrib<real_type, Vector3f, int(3)>(ss, ps_out,
                                                                name);
         break;
       case param_type_e::VEC3I:
@@ -596,23 +689,23 @@ void parse_parameters(tinyxml2::XMLElement *p_element,
         break;
       // MULTIPLE COMPOSITES
       case param_type_e::ARR_VEC3F:
-        parse_array_composite_attrib<Vector3f, float, 3>(ss, ps_out, name);
+        parse_array_composite_attrib<Vector3f, real_type, 3>(ss, ps_out, name);
         break;
       case param_type_e::ARR_VEC3I:
         parse_array_composite_attrib<Vector3i, int, 3>(ss, ps_out, name);
         break;
       case param_type_e::ARR_POINT3F:
-        parse_array_composite_attrib<Point3f, float, 3>(ss, ps_out, name);
+        parse_array_composite_attrib<Point3f, real_type, 3>(ss, ps_out, name);
         break;
       // MULTIPLE COMPOSITES PTR
       case param_type_e::PTR_ARR_PTR_NORMAL3F:
-        parse_ptr_array_ptr_composite_attrib<Normal3f, float, 3>(ss, ps_out, name);
+        parse_ptr_array_ptr_composite_attrib<Normal3f, real_type, 3>(ss, ps_out, name);
         break;
       case param_type_e::PTR_ARR_PTR_POINT2F:
-        parse_ptr_array_ptr_composite_attrib<Point2f, float, 2>(ss, ps_out, name);
+        parse_ptr_array_ptr_composite_attrib<Point2f, real_type, 2>(ss, ps_out, name);
         break;
       case param_type_e::PTR_ARR_PTR_POINT3F:
-        parse_ptr_array_ptr_composite_attrib<Point3f, float, 3>(ss, ps_out, name);
+        parse_ptr_array_ptr_composite_attrib<Point3f, real_type, 3>(ss, ps_out, name);
         break;
       case param_type_e::PTR_ARR_INT:
         parse_ptr_array_prim_attrib<int>(ss, ps_out, name);
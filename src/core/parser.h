@@ -69,6 +69,12 @@ enum class param_type_e : int {
   ACCELERATOR_TYPE,
   MATERIAL_TYPE,
   OBJECT_TYPE,
+  INTERPOLATION_TYPE,
+  LIGHT_SELECTION_TYPE,
+  SAMPLER_TYPE,
+  FILTER_TYPE,
+  EXR_COMPRESSION,
+  AOV_LIST,    //!< Names of AOVs, separated by spaces (a vector<aov_type_t>)
 // COMPOSITES
   VEC3F,       //!< Single Vector3f
   SCREEN_WINDOW,       //!< Single Vector3f
@@ -93,6 +99,9 @@ enum class param_type_e : int {
 };
 // === parsing functions.
 void parse(const char *);
+/// Hash of every scene file parsed so far (the scene file and the files it includes),
+/// so checkpoints and workers of a scene whose files differ are turned away.
+uint32_t scene_files_hash();
 void parse_tags(tinyxml2::XMLElement *, int);
 void parse_parameters(tinyxml2::XMLElement *p_element,
                       const vector<std::pair<param_type_e, string>> param_list,
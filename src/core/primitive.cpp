@@ -14,7 +14,22 @@ bool GeometricPrimitive::intersect(const Ray &r, shared_ptr<ObjSurfel> &isect )
     }else return false; 
 }
 
+void GeometricPrimitive::intersect_packet( RayPacket& packet ) const{
+    shape->intersect_packet(packet, this);
+}
+
+void Primitive::occluded( ShadowQuery *queries, int count ) const{
+    for(int q = 0; q < count; ++q){
+        if(!queries[q].occluded && intersect_p(queries[q].ray, queries[q].maxT)){
+            queries[q].occluded = true;
+            queries[q].occluder = this;
+        }
+    }
+}
+
 bool BVHAccel::intersect_p( const Ray& r, real_type maxT ) const{
+    if(!occlusionNodes.empty()) return occluded_flat(r, maxT);
+
     if(boundingBox.intersect_p(r, maxT)){
         for(auto &prim : primitives){
             if(prim->intersect_p(r, maxT)) return true;
@@ -39,6 +54,22 @@ bool BVHAccel::intersect(const Ray &r, shared_ptr<ObjSurfel> &isect ) const{
     return (isect != nullptr);
 }
 
+void BVHAccel::intersect_packet( RayPacket& packet ) const{
+    // Cheap test for the whole packet first, then the per-ray slab test.
+    if(!packet.may_hit(boundingBox)) return;
+
+    unsigned char parentActive[RayPacket::SIZE];
+    std::copy_n(packet.active, RayPacket::SIZE, parentActive);
+
+    if(packet.clip_active(boundingBox)){
+        for(auto &prim : primitives){
+            prim->intersect_packet(packet);
+        }
+    }
+
+    std::copy_n(parentActive, RayPacket::SIZE, packet.active);
+}
+
 bool PrimList::intersect(const Ray &r, shared_ptr<ObjSurfel> &isect ) const{
     shared_ptr<ObjSurfel> currIsect(nullptr);
     for(auto &prim : primitives)
@@ -61,6 +92,201 @@ bool PrimList::intersect_p(const Ray& r, real_type maxT) const{
     return false;
 }
 
+void PrimList::occluded( ShadowQuery *queries, int count ) const{
+    for(int q = 0; q < count; ++q){
+        if(queries[q].occluded) continue;
+        for(auto &prim : primitives){
+            if(prim->intersect_p(queries[q].ray, queries[q].maxT)){
+                queries[q].occluded = true;
+                queries[q].occluder = prim.get();
+                break;
+            }
+        }
+    }
+}
+
+void PrimList::intersect_packet( RayPacket& packet ) const{
+    for(auto &prim : primitives){
+        prim->intersect_packet(packet);
+    }
+}
+
+void BVHAccel::occluded( ShadowQuery *queries, int count ) const{
+    if(occlusionNodes.empty()){
+        Primitive::occluded(queries, count);
+        return;
+    }
+
+    for(int first = 0; first < count; first += 64){
+        occluded_flat(queries + first, min(64, count - first));
+    }
+}
+
+namespace{
+
+struct InvDir{
+    real_type v[3];
+
+    InvDir(const Ray &r){
+        for(int i = 0; i < 3; ++i){
+            if(r.d.at(i) == 0) v[i] = INF;
+            else v[i] = 1.0 / r.d.at(i);
+        }
+    }
+};
+
+/// Bounds3f::intersect_p() with the inverse direction computed once per ray.
+inline bool box_hit(const Bounds3f &box, const Ray &r, const InvDir &invDir, real_type maxT){
+    real_type tNear = -INF, tFar = INF;
+    for(int i = 0; i < 3; ++i){
+        real_type t0 = (box.minPoint.at(i) - r.o.at(i)) * invDir.v[i];
+        real_type t1 = (box.maxPoint.at(i) - r.o.at(i)) * invDir.v[i];
+        if(t0 > t1) swap(t0, t1);
+
+        tNear = max(tNear, t0);
+        tFar = min(tFar, t1);
+    }
+    if(!(tNear < tFar)) return false;
+
+    if(tNear > 0) return tNear < maxT;
+    else if(tFar > 0) return tFar < maxT;
+    else return false;
+}
+
+} // namespace
+
+bool BVHAccel::occluded_flat( const Ray& r, real_type maxT ) const{
+    InvDir invDir(r);
+
+    thread_local vector<int> stack;
+    stack.clear();
+    stack.push_back(0);
+
+    while(!stack.empty()){
+        const OcclusionNode &node = occlusionNodes[stack.back()];
+        stack.pop_back();
+
+        if(!box_hit(node.box, r, invDir, maxT)) continue;
+
+        for(int p = node.primStart; p < node.primEnd; ++p){
+            if(occlusionPrims[p]->intersect_p(r, maxT)) return true;
+        }
+
+        // The stack pops the last child pushed: push the far ones first.
+        if(r.d.at(node.axis) >= 0){
+            for(int c = node.childEnd - 1; c >= node.childStart; --c) stack.push_back(occlusionChildren[c]);
+        }else{
+            for(int c = node.childStart; c < node.childEnd; ++c) stack.push_back(occlusionChildren[c]);
+        }
+    }
+    return false;
+}
+
+void BVHAccel::occluded_flat( ShadowQuery *queries, int count ) const{
+    typedef unsigned long long Mask;
+
+    thread_local vector<InvDir> invDirs;
+    invDirs.clear();
+
+    Mask pending = 0;
+    for(int q = 0; q < count; ++q){
+        invDirs.emplace_back(queries[q].ray);
+        if(!queries[q].occluded) pending |= Mask(1) << q;
+    }
+
+    // Every node is visited once for the whole batch, with the rays that reached it.
+    thread_local vector<pair<int, Mask>> stack;
+    stack.clear();
+    stack.push_back({0, pending});
+
+    while(!stack.empty() && pending){
+        auto [n, mask] = stack.back();
+        stack.pop_back();
+        const OcclusionNode &node = occlusionNodes[n];
+
+        mask &= pending;
+        Mask inside = 0;
+        int dirSum = 0;
+        for(int q = 0; q < count; ++q){
+            if(!(mask >> q & 1)) continue;
+            if(box_hit(node.box, queries[q].ray, invDirs[q], queries[q].maxT)){
+                inside |= Mask(1) << q;
+                dirSum += queries[q].ray.d.at(node.axis) >= 0 ? 1 : -1;
+            }
+        }
+        if(!inside) continue;
+
+        for(int p = node.primStart; p < node.primEnd; ++p){
+            for(int q = 0; q < count; ++q){
+                if(!(inside >> q & 1)) continue;
+                if(occlusionPrims[p]->intersect_p(queries[q].ray, queries[q].maxT)){
+                    queries[q].occluded = true;
+                    queries[q].occluder = occlusionPrims[p];
+                    inside &= ~(Mask(1) << q);
+                    pending &= ~(Mask(1) << q);
+                }
+            }
+        }
+        if(!inside) continue;
+
+        // Nearer child first for most of the rays.
+        if(dirSum >= 0){
+            for(int c = node.childEnd - 1; c >= node.childStart; --c) stack.push_back({occlusionChildren[c], inside});
+        }else{
+            for(int c = node.childStart; c < node.childEnd; ++c) stack.push_back({occlusionChildren[c], inside});
+        }
+    }
+}
+
+int BVHAccel::flatten(const BVHAccel &node){
+    int index = occlusionNodes.size();
+    occlusionNodes.push_back(OcclusionNode());
+
+    vector<const BVHAccel*> childNodes;
+    vector<const Primitive*> prims;
+    for(auto &child : node.primitives){
+        auto childNode = dynamic_cast<const BVHAccel*>(child.get());
+        if(childNode) childNodes.push_back(childNode);
+        else prims.push_back(child.get());
+    }
+
+    // Sort the children along the axis where their centers spread the most.
+    auto center = [](const BVHAccel *n, int axis){
+        return n->boundingBox.minPoint.at(axis) + n->boundingBox.maxPoint.at(axis);
+    };
+    int axis = 0;
+    real_type bestSpread = -1;
+    for(int a = 0; a < 3 && childNodes.size() > 1; ++a){
+        real_type lo = INF, hi = -INF;
+        for(auto c : childNodes){
+            lo = min(lo, center(c, a));
+            hi = max(hi, center(c, a));
+        }
+        if(hi - lo > bestSpread){
+            bestSpread = hi - lo;
+            axis = a;
+        }
+    }
+    stable_sort(childNodes.begin(), childNodes.end(), [&](const BVHAccel *a, const BVHAccel *b){
+        return center(a, axis) < center(b, axis);
+    });
+
+    vector<int> childIndices;
+    for(auto c : childNodes) childIndices.push_back(flatten(*c));
+
+    OcclusionNode &flat = occlusionNodes[index];
+    flat.box = node.boundingBox;
+    flat.axis = axis;
+    flat.childStart = occlusionChildren.size();
+    occlusionChildren.insert(occlusionChildren.end(), childIndices.begin(), childIndices.end());
+    flat.childEnd = occlusionChildren.size();
+    flat.primStart = occlusionPrims.size();
+    occlusionPrims.insert(occlusionPrims.end(), prims.begin(), prims.end());
+    flat.primEnd = occlusionPrims.size();
+
+    return index;
+}
+
 bool BVHAccel::boundedComp(shared_ptr<BoundedPrimitive> a, shared_ptr<BoundedPrimitive> b){
     return a->getBoundingBox().minPoint.at(0) < b->getBoundingBox().minPoint.at(0);
 }
@@ -106,6 +332,8 @@ shared_ptr<BVHAccel> BVHAccel::build(vector<shared_ptr<BoundedPrimitive>> &&prim
         }
         currList = std::move(nextList);
     }
+
+    currList[0]->flatten(*currList[0]);
     return currList[0];
 }
 
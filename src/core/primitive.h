@@ -4,15 +4,32 @@
 #include "rt3.h"
 #include "math_base.h"
 #include "shape.h"
+#include "ray_packet.h"
 
 
 namespace rt3{
 
+class Primitive;
+
+/// A shadow ray: is anything in the way along `ray` before `maxT`?
+struct ShadowQuery{
+	Ray ray;
+	real_type maxT;
+	int light = -1;                      //!< Index of the light in the scene (-1 if none).
+	bool occluded = false;
+	const Primitive *occluder = nullptr; //!< What blocked the ray (when occluded).
+};
+
 class Primitive {
 public:
 	virtual ~Primitive(){};
 	virtual bool intersect( const Ray& r, shared_ptr<ObjSurfel> &isect ) const = 0;
 	virtual bool intersect_p( const Ray& r, real_type maxT ) const = 0;
+	/// Closest-hit query for the active rays of a packet; only records the nearest
+	/// primitive and its distance per ray (the full hit record is built afterwards).
+	virtual void intersect_packet( RayPacket& packet ) const = 0;
+	/// Answers a batch of shadow rays; queries already marked as occluded are skipped.
+	virtual void occluded( ShadowQuery *queries, int count ) const;
 };
 
 class BoundedPrimitive : public Primitive{
@@ -52,6 +69,10 @@ public:
 
 	bool intersect( const Ray& r, shared_ptr<ObjSurfel> &isect ) const override;
 
+	void intersect_packet( RayPacket& packet ) const override;
+
+	void occluded( ShadowQuery *queries, int count ) const override;
+
 };
 
 
@@ -61,6 +82,25 @@ private:
 	static vector<shared_ptr<BVHAccel>> createLeaves(vector<shared_ptr<BoundedPrimitive>> &&prim, size_t leafSize);
 	static bool boundedComp(shared_ptr<BoundedPrimitive> a, shared_ptr<BoundedPrimitive> b);
 
+	/*!
+	 * Flattened copy of the tree, kept by the root only, for the occlusion queries:
+	 * they stop at the first hit, need no hit record, and use an explicit stack
+	 * visiting the nearer child first.
+	 */
+	struct OcclusionNode{
+		Bounds3f box;
+		int axis;                   //!< Children are sorted along this axis.
+		int childStart, childEnd;   //!< Child nodes, in occlusionChildren.
+		int primStart, primEnd;     //!< Other children (the actual geometry), in occlusionPrims.
+	};
+	vector<OcclusionNode> occlusionNodes;
+	vector<int> occlusionChildren;
+	vector<const Primitive*> occlusionPrims;
+
+	int flatten(const BVHAccel &node);
+	bool occluded_flat(const Ray& r, real_type maxT) const;
+	void occluded_flat(ShadowQuery *queries, int count) const;
+
 public:
 	BVHAccel(vector<shared_ptr<BoundedPrimitive>> &&prim):AggregatePrimitive(std::move(prim)){}
 
@@ -70,6 +110,10 @@ public:
 
 	bool intersect( const Ray& r, shared_ptr<ObjSurfel> &isect ) const override;
 
+	void intersect_packet( RayPacket& packet ) const override;
+
+	void occluded( ShadowQuery *queries, int count ) const override;
+
 	static shared_ptr<BVHAccel> build(vector<shared_ptr<BoundedPrimitive>> &&prim, size_t leafSize);
 
 };
@@ -77,11 +121,12 @@ public:
 
 class GeometricPrimitive : public BoundedPrimitive,  public std::enable_shared_from_this<GeometricPrimitive>{
 public:
-	shared_ptr<Material> material;
+	const int materialId; //!< Index in the scene's MaterialTable (-1 if none).
+	int id = -1;          //!< Position in the scene description (for the primitive_id AOV).
 	unique_ptr<Shape> shape;
 
-	GeometricPrimitive(shared_ptr<Material> mat, unique_ptr<Shape> &&s):
-		BoundedPrimitive(s->computeBounds()), material(mat), shape(std::move(s)){}
+	GeometricPrimitive(int material_id, unique_ptr<Shape> &&s):
+		BoundedPrimitive(s->computeBounds()), materialId(material_id), shape(std::move(s)){}
 
 	~GeometricPrimitive(){};
 
@@ -89,7 +134,7 @@ public:
 
 	bool intersect( const Ray& r, shared_ptr<ObjSurfel> &isect ) const override;
 
-	shared_ptr<Material> get_material() const{  return material; }
+	void intersect_packet( RayPacket& packet ) const override;
 };
 
 } // namespace rt3
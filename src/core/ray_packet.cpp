@@ -0,0 +1,117 @@
+#include "ray_packet.h"
+
+namespace rt3{
+
+namespace{
+
+/// Interval product [a0,a1] * [b0,b1].
+pair<real_type, real_type> interval_mul(real_type a0, real_type a1, real_type b0, real_type b1){
+    real_type p[4] = {a0 * b0, a0 * b1, a1 * b0, a1 * b1};
+    return {min(min(p[0], p[1]), min(p[2], p[3])), max(max(p[0], p[1]), max(p[2], p[3]))};
+}
+
+inline real_type inverse(real_type d){
+    return d == 0 ? INF : real_type(1.0 / d);
+}
+
+inline void slab(real_type t0, real_type t1, real_type &tNear, real_type &tFar){
+    real_type lo = t0 > t1 ? t1 : t0;
+    real_type hi = t0 > t1 ? t0 : t1;
+    tNear = max(tNear, lo);
+    tFar = min(tFar, hi);
+}
+
+} // namespace
+
+void RayPacket::clear(){
+    count = 0;
+    rays.clear();
+}
+
+void RayPacket::add(const Ray &r, int i, int j){
+    int k = count++;
+    rays.push_back(r);
+    row[k] = i;
+    col[k] = j;
+
+    ox[k] = r.o.at(0); oy[k] = r.o.at(1); oz[k] = r.o.at(2);
+    dx[k] = r.d.at(0); dy[k] = r.d.at(1); dz[k] = r.d.at(2);
+    idx[k] = inverse(dx[k]); idy[k] = inverse(dy[k]); idz[k] = inverse(dz[k]);
+
+    tHit[k] = INF;
+    hit[k] = nullptr;
+    active[k] = 1;
+}
+
+void RayPacket::finalize(){
+    // Unused lanes still run through the vectorized loops; keep their data harmless.
+    for(int k = count; k < SIZE; ++k){
+        ox[k] = oy[k] = oz[k] = 0;
+        dx[k] = dy[k] = dz[k] = 0;
+        idx[k] = idy[k] = idz[k] = INF;
+        active[k] = 0;
+        tHit[k] = INF;
+        hit[k] = nullptr;
+    }
+
+    const real_type *o[3] = {ox, oy, oz};
+    const real_type *id[3] = {idx, idy, idz};
+    for(int a = 0; a < 3; ++a){
+        oMin[a] = idMin[a] = INF;
+        oMax[a] = idMax[a] = -INF;
+        for(int k = 0; k < count; ++k){
+            oMin[a] = min(oMin[a], o[a][k]);
+            oMax[a] = max(oMax[a], o[a][k]);
+            idMin[a] = min(idMin[a], id[a][k]);
+            idMax[a] = max(idMax[a], id[a][k]);
+        }
+    }
+}
+
+bool RayPacket::may_hit(const Bounds3f &box) const{
+    real_type nearLow = -INF, farHigh = INF;
+
+    for(int a = 0; a < 3; ++a){
+        // Directions of opposite signs along this axis: the intervals would
+        // span the whole line, so leave the decision to the per-ray test.
+        if(idMin[a] < 0 && idMax[a] > 0) return true;
+        // Same when some ray runs parallel to the slabs (infinite inverse direction).
+        if(idMax[a] >= INF) return true;
+
+        auto t0 = interval_mul(box.minPoint.at(a) - oMax[a], box.minPoint.at(a) - oMin[a], idMin[a], idMax[a]);
+        auto t1 = interval_mul(box.maxPoint.at(a) - oMax[a], box.maxPoint.at(a) - oMin[a], idMin[a], idMax[a]);
+
+        nearLow = max(nearLow, min(t0.first, t1.first));
+        farHigh = min(farHigh, max(t0.second, t1.second));
+    }
+
+    // Every ray enters the box after leaving it, or the box is behind every origin.
+    return nearLow <= farHigh && farHigh >= 0;
+}
+
+bool RayPacket::clip_active(const Bounds3f &box){
+    const real_type minX = box.minPoint.at(0), minY = box.minPoint.at(1), minZ = box.minPoint.at(2);
+    const real_type maxX = box.maxPoint.at(0), maxY = box.maxPoint.at(1), maxZ = box.maxPoint.at(2);
+
+    int anyActive = 0;
+    for(int k = 0; k < SIZE; ++k){
+        real_type t0x = (minX - ox[k]) * idx[k], t1x = (maxX - ox[k]) * idx[k];
+        real_type t0y = (minY - oy[k]) * idy[k], t1y = (maxY - oy[k]) * idy[k];
+        real_type t0z = (minZ - oz[k]) * idz[k], t1z = (maxZ - oz[k]) * idz[k];
+
+        // Same ordering as Bounds3f::box_intersect(), so NaNs (origin on a slab
+        // plane with a zero direction) are resolved the same way.
+        real_type tNear = -INF, tFar = INF;
+        slab(t0x, t1x, tNear, tFar);
+        slab(t0y, t1y, tNear, tFar);
+        slab(t0z, t1z, tNear, tFar);
+
+        // Only rays whose closest hit so far lies beyond the entry point need to go down.
+        unsigned char inside = (tNear < tFar) & (tFar >= 0) & (tNear <= tHit[k]);
+        active[k] &= inside;
+        anyActive |= active[k];
+    }
+    return anyActive;
+}
+
+} // namespace rt3
@@ -0,0 +1,52 @@
+#ifndef RAY_PACKET_H
+#define RAY_PACKET_H
+
+#include "rt3.h"
+#include "bounds.h"
+
+namespace rt3{
+
+/*!
+ * A bundle of coherent rays (a WIDTH x WIDTH block of primary rays) traced together.
+ * Origins, directions and closest hits are stored as structure-of-arrays, so the
+ * per-ray box and triangle tests run as plain loops the compiler vectorizes.
+ * The packet also keeps the range of its origins and inverse directions, which
+ * allows whole nodes to be culled with interval arithmetic before any per-ray test.
+ */
+struct RayPacket{
+    static const int WIDTH = 8;
+    static const int SIZE = WIDTH * WIDTH;
+
+    int count = 0;      //!< Rays in use; partial packets happen at the image borders.
+    vector<Ray> rays;   //!< The original rays, used to build the final hit records.
+    int row[SIZE], col[SIZE]; //!< Pixel each ray was shot through.
+
+    alignas(32) real_type ox[SIZE], oy[SIZE], oz[SIZE];    //!< Origins.
+    alignas(32) real_type dx[SIZE], dy[SIZE], dz[SIZE];    //!< Directions.
+    alignas(32) real_type idx[SIZE], idy[SIZE], idz[SIZE]; //!< Inverse directions.
+
+    alignas(32) real_type tHit[SIZE];        //!< Distance to the closest hit so far (INF if none).
+    const GeometricPrimitive *hit[SIZE];     //!< Closest primitive so far (nullptr if none).
+    alignas(32) unsigned char active[SIZE];  //!< Rays still taking part in the current subtree.
+
+    real_type oMin[3], oMax[3];   //!< Range of the origins.
+    real_type idMin[3], idMax[3]; //!< Range of the inverse directions.
+
+    RayPacket(){ rays.reserve(SIZE); }
+
+    void clear();
+    /// Appends a ray shot through pixel (i, j).
+    void add(const Ray &r, int i, int j);
+    /// Computes the packet-wide ranges; call after the last add().
+    void finalize();
+
+    /// Conservative interval-arithmetic test: false means no ray of the packet can hit `box`
+    /// before its current closest hit.
+    bool may_hit(const Bounds3f &box) const;
+    /// Per-ray slab test; deactivates the rays that miss `box`. Returns whether any ray is left.
+    bool clip_active(const Bounds3f &box);
+};
+
+} // namespace rt3
+
+#endif
@@ -0,0 +1,94 @@
+#include "ray_queue.h"
+
+namespace rt3{
+
+void RayQueue::clear(){
+    rays.clear();
+    owners.clear();
+    maxT.clear();
+    lights.clear();
+}
+
+void RayQueue::push(const Ray &r, int owner, real_type rayMaxT, int light){
+    rays.push_back(r);
+    owners.push_back(owner);
+    maxT.push_back(rayMaxT);
+    lights.push_back(light);
+}
+
+void RayQueue::sort_coherent(){
+    if(rays.empty()) return;
+
+    real_type center[3] = {0, 0, 0};
+    for(auto &r : rays){
+        for(int a = 0; a < 3; ++a) center[a] += r.o.at(a);
+    }
+    for(int a = 0; a < 3; ++a) center[a] /= rays.size();
+
+    // Direction octant in the high bits, origin octant in the low bits.
+    auto key = [&](const Ray &r){
+        int k = 0;
+        for(int a = 0; a < 3; ++a){
+            if(r.d.at(a) < 0) k |= 1 << (a + 3);
+            if(r.o.at(a) < center[a]) k |= 1 << a;
+        }
+        return k;
+    };
+
+    // Counting sort over the 64 keys: stable and linear.
+    vector<int> keys(rays.size());
+    int start[65] = {0};
+    for(int n = 0; n < size(); ++n){
+        keys[n] = key(rays[n]);
+        ++start[keys[n] + 1];
+    }
+    for(int k = 0; k < 64; ++k) start[k + 1] += start[k];
+
+    RayQueue sorted;
+    sorted.rays.resize(rays.size(), rays.front());
+    sorted.owners.resize(rays.size());
+    sorted.maxT.resize(rays.size());
+    sorted.lights.resize(rays.size());
+    for(int n = 0; n < size(); ++n){
+        int pos = start[keys[n]]++;
+        sorted.rays[pos] = rays[n];
+        sorted.owners[pos] = owners[n];
+        sorted.maxT[pos] = maxT[n];
+        sorted.lights[pos] = lights[n];
+    }
+    *this = std::move(sorted);
+}
+
+void trace_closest(const RayQueue &queue, const unique_ptr<Scene> &scene, vector<shared_ptr<ObjSurfel>> &hits){
+    hits.assign(queue.size(), nullptr);
+
+    RayPacket packet;
+    for(int first = 0; first < queue.size(); first += RayPacket::SIZE){
+        int last = min(first + RayPacket::SIZE, queue.size());
+
+        packet.clear();
+        for(int n = first; n < last; ++n) packet.add(queue.rays[n], n, 0);
+        packet.finalize();
+
+        scene->intersect_packet(packet);
+
+        for(int k = 0; k < packet.count; ++k){
+            if(!scene->packet_hit(packet, k, hits[first + k])) hits[first + k] = nullptr;
+        }
+    }
+}
+
+void trace_occluded(const RayQueue &queue, const unique_ptr<Scene> &scene, vector<char> &occluded){
+    vector<ShadowQuery> queries;
+    queries.reserve(queue.size());
+    for(int n = 0; n < queue.size(); ++n){
+        queries.push_back(ShadowQuery{queue.rays[n], queue.maxT[n], queue.lights[n]});
+    }
+
+    scene->occluded(queries);
+
+    occluded.resize(queue.size());
+    for(int n = 0; n < queue.size(); ++n) occluded[n] = queries[n].occluded;
+}
+
+} // namespace rt3
@@ -0,0 +1,38 @@
+#ifndef RAY_QUEUE_H
+#define RAY_QUEUE_H
+
+#include "rt3.h"
+#include "scene.h"
+
+namespace rt3{
+
+/*!
+ * The rays of one stage of a wavefront integrator (e.g. every mirror ray of a
+ * bounce, or every shadow ray of a tile). Each ray remembers which path it belongs
+ * to, so the queue can be reordered for coherence and traced in batches, and the
+ * results read back by the shading stage.
+ */
+struct RayQueue{
+    vector<Ray> rays;
+    vector<int> owners;       //!< Index of the path (or shading point) each ray belongs to.
+    vector<real_type> maxT;   //!< How far each ray may go (used by occlusion queries).
+    vector<int> lights;       //!< Light a shadow ray goes to (-1 if none).
+
+    void clear();
+    void push(const Ray &r, int owner, real_type rayMaxT = INF, int light = -1);
+    int size() const { return int(rays.size()); }
+
+    /// Stable reorder by direction octant, then by origin octant around the origins' centroid,
+    /// so neighbouring rays tend to visit the same BVH nodes.
+    void sort_coherent();
+};
+
+/// Closest hit of every ray in the queue (nullptr on a miss), traced RayPacket::SIZE rays at a time.
+void trace_closest(const RayQueue &queue, const unique_ptr<Scene> &scene, vector<shared_ptr<ObjSurfel>> &hits);
+
+/// Whether each ray of the queue is blocked before its maxT.
+void trace_occluded(const RayQueue &queue, const unique_ptr<Scene> &scene, vector<char> &occluded);
+
+} // namespace rt3
+
+#endif
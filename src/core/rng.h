@@ -0,0 +1,82 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include "rt3.h"
+
+#include <cstdint>
+
+namespace rt3{
+
+/// Largest float below 1.
+const real_type ONE_MINUS_EPSILON = 0x1.fffffep-1;
+
+/// Maps 32 random bits to [0, 1).
+inline real_type to_unit(uint32_t bits){
+    return min(real_type(bits * 0x1p-32), ONE_MINUS_EPSILON);
+}
+
+/*!
+ * Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3"):
+ * 128 random bits that are a function of a 128-bit counter and a 64-bit key only.
+ * There is no state to carry from one number to the next.
+ */
+inline std::array<uint32_t, 4> philox4x32(std::array<uint32_t, 4> c, std::array<uint32_t, 2> k){
+    for(int round = 0; round < 10; ++round){
+        if(round > 0){
+            k[0] += 0x9e3779b9u;
+            k[1] += 0xbb67ae85u;
+        }
+        uint64_t p0 = uint64_t(0xd2511f53u) * c[0];
+        uint64_t p1 = uint64_t(0xcd9e8d57u) * c[2];
+        c = {{ uint32_t(p1 >> 32) ^ c[1] ^ k[0], uint32_t(p1),
+               uint32_t(p0 >> 32) ^ c[3] ^ k[1], uint32_t(p0) }};
+    }
+    return c;
+}
+
+/*!
+ * Random numbers of one sample of one pixel. Number `d` of the sample (its
+ * dimension) is drawn from the counter (pixel, sample, d), so it does not depend
+ * on which thread, tile order or process rendered the pixel, nor on the samples
+ * drawn before it. Dimensions 0 and 1 belong to the film position (see Sampler);
+ * a stream starts after them, and every draw takes the next dimension.
+ */
+class RandomStream{
+public:
+    static const uint32_t FIRST_DIMENSION = 2;
+    /// Sample index of the numbers shared by every sample of a pixel (e.g. its scrambling).
+    static const uint32_t PIXEL = 0xffffffffu;
+
+    RandomStream(int i, int j, uint32_t sample, uint32_t dimension = FIRST_DIMENSION):
+        row(uint32_t(i)), col(uint32_t(j)), sample(sample), next(dimension){}
+
+    /// 32 random bits for `dimension` of sample `sample` of pixel (i, j).
+    static uint32_t bits(int i, int j, uint32_t sample, uint32_t dimension){
+        return philox4x32({{uint32_t(i), uint32_t(j), sample, dimension / 4}}, KEY)[dimension % 4];
+    }
+
+    /// Bits of the next dimension; four dimensions come out of each Philox call.
+    uint32_t bits(){
+        uint32_t d = next++;
+        if(d / 4 != block || !cached){
+            words = philox4x32({{row, col, sample, d / 4}}, KEY);
+            block = d / 4;
+            cached = true;
+        }
+        return words[d % 4];
+    }
+    /// Uniform number in [0, 1) of the next dimension.
+    real_type uniform(){ return to_unit(bits()); }
+
+private:
+    static constexpr std::array<uint32_t, 2> KEY{{0x243f6a88u, 0x85a308d3u}};
+
+    uint32_t row, col, sample, next;
+    uint32_t block = 0;
+    bool cached = false;
+    std::array<uint32_t, 4> words;
+};
+
+} // namespace rt3
+
+#endif
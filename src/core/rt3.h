@@ -7,6 +7,7 @@
 #include <typeinfo>
 #include <cmath>
 #include <cstdlib>
+#include <limits>
 #include <iostream>
 #include <memory>
 using std::shared_ptr;
@@ -50,6 +51,19 @@ namespace rt3 {
 const real_type EPS = 1e-3;
 const real_type INF = 1e18;
 
+/*!
+ * How far a ray leaving the surface at `p` (or a shadow ray ending there) stays
+ * from it, so it does not hit that surface again. `t` is the length of the ray
+ * that found `p` (or of the shadow ray): the rounding error of a hit grows with
+ * both, so past about 130 units with float the offset grows beyond EPS.
+ */
+inline real_type ray_offset(const Point3f &p, real_type t){
+  // Generous bound on the error of a computed hit point, in units of its scale.
+  const real_type ERROR_ULPS = 64;
+  real_type m = max(max(std::abs(p.at(0)), std::abs(p.at(1))), std::abs(p.at(2)));
+  return max(EPS, ERROR_ULPS * std::numeric_limits<real_type>::epsilon() * (m + t));
+}
+
 template <typename T, size_t S>
 std::ostream &operator<<(std::ostream &os, const std::array<T, S> &v) {
   os << "[ ";
@@ -72,8 +86,12 @@ enum class bg_type_t { colors = 0 };
 const vector<string> bg_type_t_names = {"colors"};
 
 /// List of support image file formats.
-enum class image_type_t : int { PNG=0, PPM3, PPM6 };
-const vector<string> image_type_t_names = {"png", "ppm3", "ppm6"};
+enum class image_type_t : int { PNG=0, PPM3, PPM6, PFM, EXR };
+const vector<string> image_type_t_names = {"png", "ppm3", "ppm6", "pfm", "exr"};
+
+/// Compression of EXR images: none, run length, or zlib one scanline / 16 scanlines at a time.
+enum class exr_compression_t : int { none = 0, rle, zips, zip };
+const vector<string> exr_compression_t_names = {"none", "rle", "zips", "zip"};
 
 /// List of supported camera types
 enum class camera_type_t : int { orthographic, perspective };
@@ -99,6 +117,26 @@ const vector<string> light_type_t_names = {"point", "directional", "ambient", "s
 enum class accelerator_type_t : int { list, bvh };
 const vector<string> accelerator_type_t_names = {"list", "bvh"};
 
+/// List of interpolation schemes for camera animation keyframes
+enum class interpolation_type_t : int { linear, catmull_rom };
+const vector<string> interpolation_type_t_names = {"linear", "catmull_rom"};
+
+/// How the lights evaluated at a shading point are chosen (see LightBVH)
+enum class light_selection_t : int { all, prune, stochastic };
+const vector<string> light_selection_t_names = {"all", "prune", "stochastic"};
+
+/// List of sample generators (how the samples of a pixel are placed)
+enum class sampler_type_t : int { center, stratified, halton, sobol };
+const vector<string> sampler_type_t_names = {"center", "stratified", "halton", "sobol"};
+
+/// List of pixel reconstruction filters (none: each pixel averages its own samples)
+enum class filter_type_t : int { none, box, tent, gaussian, mitchell };
+const vector<string> filter_type_t_names = {"none", "box", "tent", "gaussian", "mitchell"};
+
+/// First-hit data the film can write next to the image (arbitrary output variables)
+enum class aov_type_t : int { depth, normal, albedo, primitive_id };
+const vector<string> aov_type_t_names = {"depth", "normal", "albedo", "primitive_id"};
+
 //==============
 
 // Global Forward Declarations
@@ -120,7 +158,10 @@ class Light;
 struct RunningOptions {
 
 
-  RunningOptions() : filename{""}, outfile{""}, quick_render{false} {
+  RunningOptions() : program{"basic_rt3"}, filename{""}, outfile{""}, quick_render{false}, nthreads{0},
+                     progressive{false}, time_budget{0}, flush_interval{1},
+                     checkpoint_interval{0}, resume{false}, worker_port{0}, worker_fd{-1},
+                     spawn_workers{0} {
     crop_window[0][0] = 0; //!< x0
     crop_window[0][1] = 1; //!< x1,
     crop_window[1][0] = 0; //!< y0
@@ -130,10 +171,21 @@ struct RunningOptions {
   // x0, x1, y0, y1
   real_type crop_window[2][2]; //!< Crop window to render. 1 = 100% of the full
                                //!< resolution.
+  std::string program;         //!< name the renderer was started with (argv[0]).
   std::string filename;        //!< input scene file name.
   std::string outfile;         //!< output image file name.
   bool quick_render; //!< when set, render image with 1/4 of the requested
                      //!< resolution.
+  int nthreads;      //!< number of render threads; 0 means all available cores.
+  bool progressive;  //!< render in passes of increasing quality, writing the image in between.
+  real_type time_budget;    //!< seconds before rendering stops (progressive); 0 means no limit.
+  real_type flush_interval; //!< minimum seconds between two partial images (progressive).
+  real_type checkpoint_interval; //!< seconds between two checkpoints of the render; 0 means none.
+  bool resume;       //!< continue from the checkpoint of a previous, interrupted render.
+  int worker_port;   //!< when set, render tiles for a coordinator connecting on this TCP port.
+  int worker_fd;     //!< when set (>= 0), render tiles for the coordinator that started this process.
+  int spawn_workers; //!< number of worker processes to start on this machine.
+  std::vector<std::string> workers; //!< addresses (host:port) of worker processes to render on.
 };
 
 /// Lambda expression that returns a lowercase version of the input string.
@@ -151,6 +203,15 @@ auto STR_LOWERCASE = [](const string &t) -> std::string {
 
 //=== Global Inline Functions
 
+/// `filename` with `suffix` inserted before its extension (appended if it has none).
+inline string insert_before_extension(const string &filename, const string &suffix){
+  size_t dot = filename.find_last_of('.');
+  size_t slash = filename.find_last_of("/\\");
+  if(dot == string::npos || (slash != string::npos && dot < slash)){
+    return filename + suffix;
+  }
+  return filename.substr(0, dot) + suffix + filename.substr(dot);
+}
 
 } // namespace rt3
 
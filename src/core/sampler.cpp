@@ -0,0 +1,97 @@
+#include "sampler.h"
+
+namespace rt3{
+
+namespace{
+
+inline real_type radical_inverse(uint32_t n, uint32_t base){
+    real_type inverseBase = real_type(1) / base, factor = inverseBase, result = 0;
+    for(; n > 0; n /= base, factor *= inverseBase){
+        result += (n % base) * factor;
+    }
+    return min(result, ONE_MINUS_EPSILON);
+}
+
+inline real_type wrap(real_type x){
+    return x >= 1 ? x - 1 : x;
+}
+
+/// First dimension of the (0,2)-sequence: van der Corput (bit reversal).
+inline uint32_t van_der_corput(uint32_t n, uint32_t scramble){
+    n = (n << 16) | (n >> 16);
+    n = ((n & 0x00ff00ffu) << 8) | ((n & 0xff00ff00u) >> 8);
+    n = ((n & 0x0f0f0f0fu) << 4) | ((n & 0xf0f0f0f0u) >> 4);
+    n = ((n & 0x33333333u) << 2) | ((n & 0xccccccccu) >> 2);
+    n = ((n & 0x55555555u) << 1) | ((n & 0xaaaaaaaau) >> 1);
+    return n ^ scramble;
+}
+
+/// Second dimension of the (0,2)-sequence.
+inline uint32_t sobol_2(uint32_t n, uint32_t scramble){
+    for(uint32_t v = 1u << 31; n != 0; n >>= 1, v ^= v >> 1){
+        if(n & 1) scramble ^= v;
+    }
+    return scramble;
+}
+
+} // namespace
+
+void Sampler::tile_samples(int i0, int i1, int j0, int j1, int n, vector<Point2f> &out) const{
+    n = min(n, spp);
+    out.resize(size_t(i1 - i0) * (j1 - j0) * n);
+
+    Point2f *next = out.data();
+    for(int i = i0; i < i1; ++i){
+        for(int j = j0; j < j1; ++j){
+            pixel_samples(i, j, n, next);
+            next += n;
+        }
+    }
+}
+
+void CenterSampler::pixel_samples(int /* i */, int /* j */, int n, Point2f *out) const{
+    for(int s = 0; s < n; ++s){
+        out[s] = Point2f{{0.5, 0.5}};
+    }
+}
+
+StratifiedSampler::StratifiedSampler(int samples_per_pixel):Sampler(samples_per_pixel){
+    nx = int(std::sqrt(real_type(spp)));
+    while(spp % nx != 0) --nx;
+    ny = spp / nx;
+}
+
+void StratifiedSampler::pixel_samples(int i, int j, int n, Point2f *out) const{
+    for(int s = 0; s < n; ++s){
+        uint32_t r = RandomStream::bits(i, j, s, 0);
+        uint32_t c = RandomStream::bits(i, j, s, 1);
+        out[s] = Point2f{{
+            min((s / nx + to_unit(r)) / ny, ONE_MINUS_EPSILON),
+            min((s % nx + to_unit(c)) / nx, ONE_MINUS_EPSILON)
+        }};
+    }
+}
+
+void HaltonSampler::pixel_samples(int i, int j, int n, Point2f *out) const{
+    real_type shiftR = to_unit(RandomStream::bits(i, j, RandomStream::PIXEL, 0));
+    real_type shiftC = to_unit(RandomStream::bits(i, j, RandomStream::PIXEL, 1));
+    for(int s = 0; s < n; ++s){
+        out[s] = Point2f{{
+            wrap(radical_inverse(s, 3) + shiftR),
+            wrap(radical_inverse(s, 2) + shiftC)
+        }};
+    }
+}
+
+void SobolSampler::pixel_samples(int i, int j, int n, Point2f *out) const{
+    uint32_t scrambleR = RandomStream::bits(i, j, RandomStream::PIXEL, 0);
+    uint32_t scrambleC = RandomStream::bits(i, j, RandomStream::PIXEL, 1);
+    for(int s = 0; s < n; ++s){
+        out[s] = Point2f{{
+            to_unit(sobol_2(s, scrambleR)),
+            to_unit(van_der_corput(s, scrambleC))
+        }};
+    }
+}
+
+} // namespace rt3
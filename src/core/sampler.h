@@ -0,0 +1,68 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "rt3.h"
+#include "rng.h"
+
+namespace rt3{
+
+/*!
+ * Places the samples of a pixel: `spp` positions in [0,1)^2 (row, column)
+ * inside it. Their randomness (jitter, scrambling) comes from the pixel's
+ * RandomStream numbers, dimensions 0 and 1, so a tile comes out the same on any
+ * thread and in any order. Samples are generated for a whole tile at once.
+ */
+class Sampler{
+protected:
+    const int spp;
+
+    /// The first `n` (<= spp) positions of pixel (i, j).
+    virtual void pixel_samples(int i, int j, int n, Point2f *out) const = 0;
+
+public:
+    Sampler(int samples_per_pixel):spp(std::max(1, samples_per_pixel)){}
+    virtual ~Sampler() = default;
+
+    int samples_per_pixel() const{ return spp; }
+
+    /// First `n` samples of the pixels [i0, i1) x [j0, j1), pixel by pixel in row order, `n` in a row for each.
+    void tile_samples(int i0, int i1, int j0, int j1, int n, vector<Point2f> &out) const;
+};
+
+/// Every sample at the pixel center (no antialiasing).
+class CenterSampler : public Sampler{
+protected:
+    void pixel_samples(int i, int j, int n, Point2f *out) const override;
+public:
+    using Sampler::Sampler;
+};
+
+/// One jittered sample per cell of a nx x ny grid (nx * ny = spp, as square as possible).
+class StratifiedSampler : public Sampler{
+private:
+    int nx, ny;
+protected:
+    void pixel_samples(int i, int j, int n, Point2f *out) const override;
+public:
+    StratifiedSampler(int samples_per_pixel);
+};
+
+/// Halton points (bases 2 and 3), randomly shifted (modulo 1) for each pixel.
+class HaltonSampler : public Sampler{
+protected:
+    void pixel_samples(int i, int j, int n, Point2f *out) const override;
+public:
+    using Sampler::Sampler;
+};
+
+/// Sobol (0,2)-sequence, with random digit (XOR) scrambling for each pixel.
+class SobolSampler : public Sampler{
+protected:
+    void pixel_samples(int i, int j, int n, Point2f *out) const override;
+public:
+    using Sampler::Sampler;
+};
+
+} // namespace rt3
+
+#endif
@@ -1,6 +1,25 @@
 #include "scene.h"
+#include "light_bvh.h"
+#include "stats.h"
+
+#include <atomic>
 
 namespace rt3{
+    static StatCounter shadowRays("Shadow rays", "Rays traced");
+    static StatRatio occluderCacheHits("Shadow rays", "Occluder cache hits");
+
+    Scene::Scene(unique_ptr<Background> &&bg, shared_ptr<Primitive> &&prim, vector<shared_ptr<Light>> &&sceneLights,
+            shared_ptr<const MaterialTable> &&table):
+        background(std::move(bg)), primitive(std::move(prim)), lights(std::move(sceneLights)),
+        materials(std::move(table)), id(next_id()){
+        lightTree = make_shared<LightBVH>(lights);
+    }
+
+    unsigned long Scene::next_id(){
+        static std::atomic<unsigned long> counter{0};
+        return ++counter;
+    }
+
     bool Scene::intersect(const Ray &r, shared_ptr<ObjSurfel> &isect) const{
         return primitive->intersect(r, isect);
     }
@@ -9,4 +28,49 @@ namespace rt3{
         return primitive->intersect_p(r, maxT);
     }
 
+    void Scene::occluded(vector<ShadowQuery> &queries) const{
+        // Last occluder of each light, for the scene this thread rendered last.
+        struct OccluderCache{
+            unsigned long scene = 0;
+            vector<const Primitive*> last;
+        };
+        thread_local OccluderCache cache;
+        if(cache.scene != id){
+            cache.scene = id;
+            cache.last.assign(lights.size(), nullptr);
+        }
+
+        for(auto &q : queries){
+            if(q.light < 0 || q.occluded) continue;
+
+            const Primitive *last = cache.last[q.light];
+            bool hit = last != nullptr && last->intersect_p(q.ray, q.maxT);
+            if(hit){
+                q.occluded = true;
+                q.occluder = last;
+            }
+            occluderCacheHits.add(hit);
+        }
+
+        primitive->occluded(queries.data(), queries.size());
+
+        for(auto &q : queries){
+            if(q.light >= 0 && q.occluded) cache.last[q.light] = q.occluder;
+        }
+        shadowRays.add(queries.size());
+    }
+
+    void Scene::intersect_packet(RayPacket &packet) const{
+        primitive->intersect_packet(packet);
+    }
+
+    bool Scene::packet_hit(const RayPacket &packet, int k, shared_ptr<ObjSurfel> &isect) const{
+        if(packet.hit[k] == nullptr) return false;
+
+        // The packet only tells which primitive is hit; the full hit record
+        // (normal, material, ...) comes from that primitive alone.
+        if(packet.hit[k]->intersect(packet.rays[k], isect)) return true;
+        return intersect(packet.rays[k], isect);
+    }
+
 }
\ No newline at end of file
@@ -8,19 +8,36 @@
 
 namespace rt3{
 
+class LightBVH;
+class MaterialTable;
+
 class Scene{
 public:
     unique_ptr<Background> background;
     shared_ptr<Primitive> primitive;
     vector<shared_ptr<Light>> lights;
+    shared_ptr<LightBVH> lightTree; //!< Hierarchy over the lights that have a position.
+    shared_ptr<const MaterialTable> materials; //!< Indexed by GeometricPrimitive::materialId.
+    const unsigned long id; //!< Unique among all scenes created by the process.
 
-    Scene(unique_ptr<Background> &&bg, shared_ptr<Primitive> &&prim, vector<shared_ptr<Light>> &&sceneLights):
-        background(std::move(bg)), primitive(std::move(prim)), lights(std::move(sceneLights)){}
+    Scene(unique_ptr<Background> &&bg, shared_ptr<Primitive> &&prim, vector<shared_ptr<Light>> &&sceneLights,
+        shared_ptr<const MaterialTable> &&table);
 
     ~Scene() = default;
 
     bool intersect(const Ray &r, shared_ptr<ObjSurfel> &isect) const;
     bool intersect_p(const Ray &r, real_type maxT) const;
+    /// Answers a batch of shadow rays at once (e.g. one per light at a shading point).
+    /// For queries tagged with a light, the primitive that last blocked that light
+    /// (on this thread) is tested first, and the full traversal is skipped if it blocks again.
+    void occluded(vector<ShadowQuery> &queries) const;
+    /// Closest primitive and distance for every ray of the packet.
+    void intersect_packet(RayPacket &packet) const;
+    /// Full hit record of the k-th ray of a traced packet; false if that ray hit nothing.
+    bool packet_hit(const RayPacket &packet, int k, shared_ptr<ObjSurfel> &isect) const;
+
+private:
+    static unsigned long next_id();
 };
 
 } // namespace rt3
@@ -0,0 +1,17 @@
+#include "shape.h"
+
+namespace rt3{
+
+void Shape::intersect_packet(RayPacket &packet, const GeometricPrimitive *owner) const{
+    for(int k = 0; k < packet.count; ++k){
+        if(!packet.active[k]) continue;
+
+        shared_ptr<ObjSurfel> isect;
+        if(intersect(packet.rays[k], isect) && isect->t < packet.tHit[k]){
+            packet.tHit[k] = isect->t;
+            packet.hit[k] = owner;
+        }
+    }
+}
+
+} // namespace rt3
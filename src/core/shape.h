@@ -5,6 +5,7 @@
 #include "paramset.h"
 #include "surfel.h"
 #include "bounds.h"
+#include "ray_packet.h"
 
 namespace rt3{
 
@@ -18,6 +19,10 @@ public:
 
     virtual bool intersect_p(const Ray &r, real_type maxT) const = 0;
     virtual bool intersect(const Ray &r, shared_ptr<ObjSurfel> &isect) const = 0;
+
+    /// Updates the closest hits of the packet's active rays that hit this shape,
+    /// recording `owner` as the hit primitive. Defaults to one scalar test per ray.
+    virtual void intersect_packet(RayPacket &packet, const GeometricPrimitive *owner) const;
 };
 
 } // namespace rt3
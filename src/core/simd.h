@@ -0,0 +1,87 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cmath>
+
+// SSE2 is part of every x86-64 target; RT3_NO_SIMD (CMake: -DRT3_SIMD=OFF) forces the scalar code.
+#if defined(__SSE2__) && !defined(RT3_NO_SIMD)
+#define RT3_SIMD_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace rt3{
+
+/*!
+ * Four floats handled at once: the lanes of a Point3f, Vector3f, Normal3f or Color,
+ * whose fourth lane is kept at 0. Every operation rounds exactly like the scalar
+ * code it replaces (same operations, same order, no approximate reciprocals), so
+ * images do not depend on whether, or on which CPU, it runs on SSE.
+ */
+class Float4{
+public:
+#if defined(RT3_SIMD_SSE)
+    /// Loads 16-byte aligned floats.
+    static Float4 load(const float *p){ return Float4(_mm_load_ps(p)); }
+    void store(float *p) const{ _mm_store_ps(p, v); }
+    static Float4 broadcast(float x){ return Float4(_mm_set1_ps(x)); }
+
+    friend Float4 operator+(Float4 a, Float4 b){ return Float4(_mm_add_ps(a.v, b.v)); }
+    friend Float4 operator-(Float4 a, Float4 b){ return Float4(_mm_sub_ps(a.v, b.v)); }
+    friend Float4 operator*(Float4 a, Float4 b){ return Float4(_mm_mul_ps(a.v, b.v)); }
+    friend Float4 operator/(Float4 a, Float4 b){ return Float4(_mm_div_ps(a.v, b.v)); }
+    /// Lane-wise min/max; like std::min/max, they return `a` when a lane of either is NaN.
+    friend Float4 min(Float4 a, Float4 b){ return Float4(_mm_min_ps(b.v, a.v)); }
+    friend Float4 max(Float4 a, Float4 b){ return Float4(_mm_max_ps(b.v, a.v)); }
+    friend Float4 fabs(Float4 a){ return Float4(_mm_andnot_ps(_mm_set1_ps(-0.f), a.v)); }
+
+    /// 0 + x*x' + y*y' + z*z', summed left to right.
+    friend float dot3(Float4 a, Float4 b){
+        __m128 m = _mm_mul_ps(a.v, b.v);
+        __m128 y = _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 1, 1, 1));
+        __m128 z = _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 2, 2, 2));
+        return _mm_cvtss_f32(_mm_add_ss(_mm_add_ss(_mm_add_ss(_mm_setzero_ps(), m), y), z));
+    }
+    /// Cross product of the first three lanes (the fourth stays 0 if it was 0 in both).
+    friend Float4 cross3(Float4 a, Float4 b){
+        __m128 a_yzx = _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 a_zxy = _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(3, 1, 0, 2));
+        __m128 b_yzx = _mm_shuffle_ps(b.v, b.v, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 b_zxy = _mm_shuffle_ps(b.v, b.v, _MM_SHUFFLE(3, 1, 0, 2));
+        return Float4(_mm_sub_ps(_mm_mul_ps(a_yzx, b_zxy), _mm_mul_ps(a_zxy, b_yzx)));
+    }
+
+private:
+    __m128 v;
+    explicit Float4(__m128 x):v(x){}
+#else
+    static Float4 load(const float *p){ Float4 r; for(int k = 0; k < 4; ++k) r.v[k] = p[k]; return r; }
+    void store(float *p) const{ for(int k = 0; k < 4; ++k) p[k] = v[k]; }
+    static Float4 broadcast(float x){ Float4 r; for(int k = 0; k < 4; ++k) r.v[k] = x; return r; }
+
+    friend Float4 operator+(Float4 a, Float4 b){ for(int k = 0; k < 4; ++k) a.v[k] += b.v[k]; return a; }
+    friend Float4 operator-(Float4 a, Float4 b){ for(int k = 0; k < 4; ++k) a.v[k] -= b.v[k]; return a; }
+    friend Float4 operator*(Float4 a, Float4 b){ for(int k = 0; k < 4; ++k) a.v[k] *= b.v[k]; return a; }
+    friend Float4 operator/(Float4 a, Float4 b){ for(int k = 0; k < 4; ++k) a.v[k] /= b.v[k]; return a; }
+    friend Float4 min(Float4 a, Float4 b){ for(int k = 0; k < 4; ++k) a.v[k] = b.v[k] < a.v[k] ? b.v[k] : a.v[k]; return a; }
+    friend Float4 max(Float4 a, Float4 b){ for(int k = 0; k < 4; ++k) a.v[k] = a.v[k] < b.v[k] ? b.v[k] : a.v[k]; return a; }
+    friend Float4 fabs(Float4 a){ for(int k = 0; k < 4; ++k) a.v[k] = std::fabs(a.v[k]); return a; }
+
+    friend float dot3(Float4 a, Float4 b){ float sum = 0; for(int k = 0; k < 3; ++k) sum += a.v[k] * b.v[k]; return sum; }
+    friend Float4 cross3(Float4 a, Float4 b){
+        Float4 r;
+        r.v[0] = a.v[1] * b.v[2] - a.v[2] * b.v[1];
+        r.v[1] = a.v[2] * b.v[0] - a.v[0] * b.v[2];
+        r.v[2] = a.v[0] * b.v[1] - a.v[1] * b.v[0];
+        r.v[3] = a.v[3] * b.v[3] - a.v[3] * b.v[3];
+        return r;
+    }
+
+private:
+    alignas(16) float v[4];
+    Float4(){}
+#endif
+};
+
+} // namespace rt3
+
+#endif
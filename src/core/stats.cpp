@@ -0,0 +1,76 @@
+#include "stats.h"
+#include "error.h"
+
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace rt3{
+
+namespace{
+
+std::vector<StatCounter*> &counters(){
+    static std::vector<StatCounter*> all;
+    return all;
+}
+
+std::vector<StatRatio*> &ratios(){
+    static std::vector<StatRatio*> all;
+    return all;
+}
+
+} // namespace
+
+StatCounter::StatCounter(const std::string &_category, const std::string &_name):
+    category(_category), name(_name){
+    counters().push_back(this);
+}
+
+StatRatio::StatRatio(const std::string &_category, const std::string &_name):
+    category(_category), name(_name){
+    ratios().push_back(this);
+}
+
+StatCounter &stat_counter(const std::string &category, const std::string &name){
+    static std::mutex mutex;
+    static std::map<std::pair<std::string, std::string>, std::unique_ptr<StatCounter>> dynamicCounters;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &counter = dynamicCounters[{category, name}];
+    if(!counter) counter.reset(new StatCounter(category, name));
+    return *counter;
+}
+
+void report_render_stats(){
+    // category -> lines, so the report does not depend on the registration order.
+    std::map<std::string, std::vector<std::string>> lines;
+
+    for(auto c : counters()){
+        if(c->value() == 0) continue;
+        lines[c->get_category()].push_back(c->get_name() + ": " + std::to_string(c->value()));
+    }
+    for(auto r : ratios()){
+        if(r->total_count() == 0) continue;
+        char rate[32];
+        std::snprintf(rate, sizeof(rate), "%.1f%%", 100.0 * r->hit_count() / r->total_count());
+        lines[r->get_category()].push_back(r->get_name() + ": " + std::to_string(r->hit_count()) + " / " +
+            std::to_string(r->total_count()) + " (" + rate + ")");
+    }
+
+    if(lines.empty()) return;
+
+    RT3_MESSAGE("    Render statistics:");
+    for(auto &[category, entries] : lines){
+        RT3_MESSAGE("      " + category);
+        for(auto &entry : entries) RT3_MESSAGE("        " + entry);
+    }
+}
+
+void reset_render_stats(){
+    for(auto c : counters()) c->reset();
+    for(auto r : ratios()) r->reset();
+}
+
+} // namespace rt3
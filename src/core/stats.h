@@ -0,0 +1,61 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <string>
+
+namespace rt3{
+
+/*!
+ * A named event counter, reported at the end of the render.
+ * Counters are meant to be global objects (one per event), updated from any
+ * render thread; they register themselves on construction.
+ */
+class StatCounter{
+private:
+    const std::string category, name;
+    std::atomic<long long> count{0};
+
+public:
+    StatCounter(const std::string &category, const std::string &name);
+
+    void add(long long n = 1){ count.fetch_add(n, std::memory_order_relaxed); }
+    long long value() const { return count.load(std::memory_order_relaxed); }
+    void reset(){ count.store(0, std::memory_order_relaxed); }
+
+    const std::string &get_category() const { return category; }
+    const std::string &get_name() const { return name; }
+};
+
+/// Two counts reported together as "hits / total (rate%)", e.g. a cache hit rate.
+class StatRatio{
+private:
+    const std::string category, name;
+    std::atomic<long long> hits{0}, total{0};
+
+public:
+    StatRatio(const std::string &category, const std::string &name);
+
+    void add(bool hit){
+        total.fetch_add(1, std::memory_order_relaxed);
+        if(hit) hits.fetch_add(1, std::memory_order_relaxed);
+    }
+    long long hit_count() const { return hits.load(std::memory_order_relaxed); }
+    long long total_count() const { return total.load(std::memory_order_relaxed); }
+    void reset(){ hits.store(0, std::memory_order_relaxed); total.store(0, std::memory_order_relaxed); }
+
+    const std::string &get_category() const { return category; }
+    const std::string &get_name() const { return name; }
+};
+
+/// Counter created on demand (e.g. one per light of the scene); the same name gives the same counter.
+StatCounter &stat_counter(const std::string &category, const std::string &name);
+
+/// Prints every non-zero counter, grouped by category.
+void report_render_stats();
+/// Zeroes every counter (e.g. before rendering a new scene).
+void reset_render_stats();
+
+} // namespace rt3
+
+#endif
@@ -1,7 +1,11 @@
 #include "blinn_phong.h"
 
+#include "../core/light_bvh.h"
+#include "../core/ray_queue.h"
 #include "../lights/ambient.h"
-#include "../materials/blinn_phong.h"
+#include "../materials/material_table.h"
+
+#include <iterator>
 
 namespace rt3{
 
@@ -10,60 +14,323 @@ Vector3f computeHalfVector(const Vector3f &viewDir, const Vector3f &lightDir){
     return h.normalize() * -1;
 }
 
-Color BlinnPhongIntegrator::Li(const Ray& ray, const unique_ptr<Scene>& scene, const Color backgroundColor) const{
-    return recursiveLi(ray, scene, backgroundColor, 1);
+void BlinnPhongIntegrator::light_terms(const Ray& ray, const shared_ptr<ObjSurfel>& isect, const BlinnPhongMaterial &material,
+        const Color &lightColor, const Vector3f &lightDir, Color &diffuse, Color &specular) const{
+    // difuse
+    {
+        real_type coef = max(real_type(0), isect->n * (lightDir * -1));
+        diffuse = material.diffuse * lightColor * coef;
+    }
+    
+    // specular
+    specular = BLACK;
+    if(material.glossiness){
+        auto h = computeHalfVector(ray.d, lightDir);
+
+        real_type coef = max(real_type(0), isect->n * h);
+        coef = pow(coef, material.glossiness);
+        specular = material.specular * lightColor * coef;
+    }
 }
 
-Color BlinnPhongIntegrator::recursiveLi(const Ray& ray, const unique_ptr<Scene>& scene, const Color backgroundColor, int currRecurStep) const{
-    shared_ptr<ObjSurfel> isect; // Intersection information.  
-    if (!scene->intersect(ray, isect)) {
-        return backgroundColor;
+void BlinnPhongIntegrator::sample_light(int l, real_type weight, const Ray& ray, const shared_ptr<ObjSurfel>& isect,
+        const BlinnPhongMaterial &material, const unique_ptr<Scene>& scene, vector<LightSample> &samples, vector<ShadowQuery> &queries) const{
+    auto &light = scene->lights[l];
+    if(typeid(*light) == typeid(AmbientLight)){
+        samples.push_back(LightSample{light->colorIntensity * material.ambient, BLACK});
+        return;
+    }
+
+    shared_ptr<SamplerLight> samplerLight = std::dynamic_pointer_cast<SamplerLight>(light);
+
+    auto [lightColor, visTester, lightDir] = samplerLight->Li(isect);
+
+    LightSample sample;
+    light_terms(ray, isect, material, lightColor, lightDir, sample.diffuse, sample.specular);
+    if(weight != 1){
+        sample.diffuse = sample.diffuse * weight;
+        sample.specular = sample.specular * weight;
+    }
+
+    // Contribution first: only lights that would add something are worth a shadow ray.
+    bool backFacing = isect->n * (lightDir * -1) <= 0;
+    Color contribution = sample.diffuse + sample.specular;
+    real_type strongest = max(contribution.at(0), max(contribution.at(1), contribution.at(2)));
+    if(backFacing || strongest <= shadowCutoff){
+        if(light->shadowRaysAvoided) light->shadowRaysAvoided->add();
+        return;
+    }
+
+    sample.query = queries.size();
+    queries.push_back(ShadowQuery{visTester->shadow_ray(), visTester->shadow_max_t(), l});
+    samples.push_back(sample);
+}
+
+void BlinnPhongIntegrator::sample_lights(const Ray& ray, const shared_ptr<ObjSurfel>& isect, const BlinnPhongMaterial &material,
+        const unique_ptr<Scene>& scene, RandomStream &rng, vector<LightSample> &samples, vector<ShadowQuery> &queries) const{
+    const LightBVH &tree = *scene->lightTree;
+
+    if(lightSelection == light_selection_t::all || tree.empty()){
+        for(int l = 0; l < int(scene->lights.size()); ++l){
+            sample_light(l, 1, ray, isect, material, scene, samples, queries);
+        }
+        return;
+    }
+
+    // Reflectance bounds for the light tree.
+    auto strongest = [](const Color &c){ return max(c.at(0), max(c.at(1), c.at(2))); };
+    real_type diffuse = strongest(material.diffuse);
+    real_type specular = material.glossiness ? strongest(material.specular) : 0;
+
+    if(lightSelection == light_selection_t::prune){
+        // Every light that may add more than the cutoff, still in scene order.
+        thread_local vector<int> kept, selected;
+        tree.prune(isect->p, isect->n, diffuse, specular, shadowCutoff, kept);
+
+        selected.clear();
+        std::merge(kept.begin(), kept.end(), tree.unbounded().begin(), tree.unbounded().end(), std::back_inserter(selected));
+        for(int l : selected){
+            sample_light(l, 1, ray, isect, material, scene, samples, queries);
+        }
     }else{
+        for(int l : tree.unbounded()){
+            sample_light(l, 1, ray, isect, material, scene, samples, queries);
+        }
+
+        for(int s = 0; s < lightSamples; ++s){
+            real_type pdf;
+            int l = tree.sample(isect->p, isect->n, diffuse, specular, rng.uniform(), pdf);
+            if(l >= 0) sample_light(l, 1 / (pdf * lightSamples), ray, isect, material, scene, samples, queries);
+        }
+    }
+}
+
+Color BlinnPhongIntegrator::gather_lights(const LightSample *first, const LightSample *last, const vector<ShadowQuery> &queries) const{
+    Color color;
+    for(auto sample = first; sample != last; ++sample){
+        if(sample->query >= 0 && queries[sample->query].occluded) continue;
+        color = color + sample->diffuse;
+        color = color + sample->specular;
+    }
+    // Not clamped: a light drawn with weight 1/pdf must keep all of it for the average to be right.
+    return color;
+}
+
+Ray BlinnPhongIntegrator::reflected_ray(const Ray& ray, const shared_ptr<ObjSurfel>& isect) const{
+    Vector3f newDir = (ray.d + (isect->n * (-2 * (ray.d * isect->n)))).normalize();
+    return Ray(isect->p + newDir * ray_offset(isect->p, isect->t), newDir);
+}
+
+Color BlinnPhongIntegrator::direct_light(const Ray& ray, const shared_ptr<ObjSurfel>& isect, const BlinnPhongMaterial &material, const unique_ptr<Scene>& scene, RandomStream &rng) const{
+    // Scratch space reused by every shading point of this thread.
+    thread_local vector<LightSample> samples;
+    thread_local vector<ShadowQuery> queries;
+    samples.clear();
+    queries.clear();
+
+    sample_lights(ray, isect, material, scene, rng, samples, queries);
+    scene->occluded(queries);
+
+    return gather_lights(samples.data(), samples.data() + samples.size(), queries);
+}
+
+bool BlinnPhongIntegrator::continue_path(int depth, Color &throughput, Color &mirror, RandomStream &rng) const{
+    if(depth >= maxRecursionSteps) return false;
+
+    // A black mirror adds nothing more, whatever the rest of the path.
+    Color next = throughput * mirror;
+    real_type strongest = max(next.at(0), max(next.at(1), next.at(2)));
+    if(strongest <= 0 || strongest < minThroughput) return false;
+
+    if(rouletteDepth > 0 && depth >= rouletteDepth){
+        real_type survive = min(real_type(1), strongest);
+        if(rng.uniform() >= survive) return false;
+        mirror = mirror * (1 / survive);
+        next = next * (1 / survive);
+    }
+
+    throughput = next;
+    return true;
+}
+
+Color BlinnPhongIntegrator::fold_path(const vector<PathVertex> &vertices, bool ended, const Color &tail){
+    Color color = tail;
+    for(int v = int(vertices.size()) - 1; v >= 0; --v){
+        const PathVertex &vertex = vertices[v];
+        bool last = (v + 1 == int(vertices.size()));
+        if(last && !ended) color = vertex.local; // stopped bouncing here
+        else color = vertex.local + vertex.mirror * color;
+    }
+    return color;
+}
+
+Color BlinnPhongIntegrator::shade(const Ray& ray, const shared_ptr<ObjSurfel>& isect, const unique_ptr<Scene>& scene, const Color backgroundColor, RandomStream &rng) const{
+    thread_local vector<PathVertex> vertices;
+    vertices.clear();
+
+    Ray currRay = ray;
+    shared_ptr<ObjSurfel> currIsect = isect;
+    Color throughput({1, 1, 1});
+
+    for(int depth = 1; ; ++depth){
+        if(currIsect == nullptr) return fold_path(vertices, true, backgroundColor);
+        if(currIsect->wo * currIsect->n < 0) return fold_path(vertices, true, BLACK);
+
+        const BlinnPhongMaterial *material = scene->materials->get<BlinnPhongMaterial>(currIsect->primitive->materialId);
+
+        Color local = direct_light(currRay, currIsect, *material, scene, rng);
+        Color mirror = material->mirror;
+        bool bounce = continue_path(depth, throughput, mirror, rng);
+        vertices.push_back(PathVertex{local, mirror});
+        if(!bounce) return fold_path(vertices, false, BLACK);
+
+        currRay = reflected_ray(currRay, currIsect);
+        currIsect = nullptr; // a non-null surfel would act as the closest hit so far
+        if(!scene->intersect(currRay, currIsect)) currIsect = nullptr;
+    }
+}
+
+struct BlinnPhongIntegrator::Path{
+    int i, j;
+    Point2f offset;
+    Color background;
+    RandomStream rng;    //!< Same draws, in the same order, as shade() makes for this sample.
+    shared_ptr<ObjSurfel> firstHit; //!< Kept for the AOVs only.
+    vector<PathVertex> vertices;
+    Color throughput = Color({1, 1, 1});
+    bool ended = false;  //!< Path left the scene or hit a back face, with radiance `tail`.
+    Color tail;
+};
 
-        if(isect->wo * isect->n < 0) return BLACK;
-
-        shared_ptr<BlinnPhongMaterial> material = \
-            std::dynamic_pointer_cast<BlinnPhongMaterial>(isect->primitive->get_material());
-
-        Color color;
-        for(auto &light : scene->lights){
-            if(typeid(*light) == typeid(AmbientLight)){
-                color = color + light->colorIntensity * material->ambient;
-            }else{
-                shared_ptr<SamplerLight> samplerLight = std::dynamic_pointer_cast<SamplerLight>(light);
-
-                auto [lightColor, visTester, lightDir] = samplerLight->Li(isect);
-
-
-                if(visTester->unoccluded(scene)){ // 
-                    // difuse
-                    {
-                        real_type coef = max(real_type(0), isect->n * (lightDir * -1));
-                        Color diffuseContrib = material->diffuse * lightColor * coef;
-                        
-                        color = color + diffuseContrib;
-                    }
-                    
-                    // specular
-                    if(material->glossiness){
-                        auto h = computeHalfVector(ray.d, lightDir);
-
-                        real_type coef = max(real_type(0), isect->n * h);
-                        coef = pow(coef, material->glossiness);
-                        Color specularContrib = material->specular * lightColor * coef;
-                    
-                        color = color + specularContrib;
-                    }
+void BlinnPhongIntegrator::render_tile(const unique_ptr<Scene>& scene, TileAccumulator &pixels) const{
+    if(wavefront) render_tile_wavefront(scene, pixels);
+    else SamplerIntegrator::render_tile(scene, pixels);
+}
+
+
+/*!
+ * Same result as shade() for every pixel of the tile, but the work is
+ * done breadth-first: every ray of a bounce is queued, sorted for coherence and
+ * traced in packets; the hits are then shaded, which queues the shadow rays of
+ * the bounce (also sorted and traced together) and the mirror rays of the next one.
+ * Each hit only stores its local term and mirror weight; the paths are folded
+ * back to front at the end, as in shade().
+ * With adaptive sampling, the samples are taken in rounds of `adaptive_batch`
+ * per pixel, each round only for the pixels that still need them.
+ */
+void BlinnPhongIntegrator::render_tile_wavefront(const unique_ptr<Scene>& scene, TileAccumulator &pixels) const{
+    const int i0 = pixels.i0, i1 = pixels.i1, j0 = pixels.j0, j1 = pixels.j1;
+    vector<Path> paths;
+    RayQueue queue;
+
+    const int n = pixels.sample_limit();
+    vector<Point2f> offsets;
+    sampler->tile_samples(i0, i1, j0, j1, n, offsets);
+
+    const int round = adaptive_threshold > 0 ? adaptive_batch : sampler->samples_per_pixel();
+    while(true){
+        paths.clear();
+        queue.clear();
+
+        const Point2f *offset = offsets.data();
+        for ( int i = i0 ; i < i1; i++ ) {
+            for( int j = j0 ; j < j1 ; j++, offset += n ) {
+                if(!pixels.needs_samples(i, j)) continue;
+
+                // Up to the end of the pixel's current round, within the pass limit.
+                Color background = background_at(scene, i, j);
+                int first = pixels.count(i, j);
+                for( int s = first; s < (first / round + 1) * round && s < n; s++ ) {
+                    queue.push(camera->generate_ray( film_position(i, j, offset[s]) ), paths.size());
+                    paths.push_back(Path{i, j, offset[s], background, RandomStream(i, j, s)});
                 }
             }
         }
+        if(paths.empty()) break;
+
+        trace_paths(scene, paths, queue);
+
+        // Fold every path back to front.
+        for(auto &path : paths){
+            if(pixels.has_aovs()) add_aov(scene, pixels, path.i, path.j, path.firstHit);
+            pixels.add( path.i, path.j, path.offset, fold_path(path.vertices, path.ended, path.tail) );
+        }
+    }
+}
+
+void BlinnPhongIntegrator::trace_paths(const unique_ptr<Scene>& scene, vector<Path> &paths, RayQueue &queue) const{
+    RayQueue nextQueue, shadowQueue;
+
+    vector<shared_ptr<ObjSurfel>> hits;
+    vector<const BlinnPhongMaterial*> materials;
+    vector<Color> mirrors;
+    vector<int> firstSample;
+    vector<LightSample> samples;
+    vector<ShadowQuery> queries;
+    vector<char> occluded;
+
+    for(int step = 1; queue.size() > 0; ++step){
+        // [1] Closest hits of the whole bounce.
+        queue.sort_coherent();
+        trace_closest(queue, scene, hits);
+
+        // [2] Light samples of every hit, with the shadow rays they need.
+        materials.assign(queue.size(), nullptr);
+        mirrors.resize(queue.size());
+        firstSample.assign(queue.size() + 1, 0);
+        samples.clear();
+        queries.clear();
+        shadowQueue.clear();
+        nextQueue.clear();
+
+        for(int n = 0; n < queue.size(); ++n){
+            firstSample[n] = samples.size();
+            Path &path = paths[queue.owners[n]];
+            const shared_ptr<ObjSurfel> &isect = hits[n];
+            if(step == 1 && camera->film->has_aovs()) path.firstHit = isect;
+
+            if(isect == nullptr){
+                path.ended = true;
+                path.tail = path.background;
+                continue;
+            }
+            if(isect->wo * isect->n < 0){
+                path.ended = true;
+                path.tail = BLACK;
+                continue;
+            }
+
+            materials[n] = scene->materials->get<BlinnPhongMaterial>(isect->primitive->materialId);
+
+            sample_lights(queue.rays[n], isect, *materials[n], scene, path.rng, samples, queries);
+
+            mirrors[n] = materials[n]->mirror;
+            if(continue_path(step, path.throughput, mirrors[n], path.rng)){
+                nextQueue.push(reflected_ray(queue.rays[n], isect), queue.owners[n]);
+            }
+        }
+        firstSample[queue.size()] = samples.size();
+
+        // [3] Shadow rays of the whole bounce.
+        for(int q = 0; q < int(queries.size()); ++q){
+            shadowQueue.push(queries[q].ray, q, queries[q].maxT, queries[q].light);
+        }
+        shadowQueue.sort_coherent();
+        trace_occluded(shadowQueue, scene, occluded);
+        for(int q = 0; q < shadowQueue.size(); ++q){
+            queries[shadowQueue.owners[q]].occluded = occluded[q];
+        }
+
+        // [4] Local shading, adding the lights in scene order.
+        for(int n = 0; n < queue.size(); ++n){
+            if(materials[n] == nullptr) continue;
 
-        if(currRecurStep < maxRecursionSteps){
-            Vector3f newDir = (ray.d + (isect->n * (-2 * (ray.d * isect->n)))).normalize();
-            color = color + material->mirror * recursiveLi(Ray(isect->p + newDir * EPS, newDir), scene, backgroundColor, currRecurStep + 1);
+            Color color = gather_lights(samples.data() + firstSample[n], samples.data() + firstSample[n + 1], queries);
+
+            paths[queue.owners[n]].vertices.push_back(PathVertex{color, mirrors[n]});
         }
 
-        return color;
+        std::swap(queue, nextQueue);
     }
 }
 
@@ -71,9 +338,15 @@ Color BlinnPhongIntegrator::recursiveLi(const Ray& ray, const unique_ptr<Scene>&
 BlinnPhongIntegrator* create_blinn_phong_integrator(const ParamSet & ps_integrator, unique_ptr<Camera> &&camera){
     return new BlinnPhongIntegrator(
         std::move(camera),
-        retrieve(ps_integrator, "depth", int(1))
+        retrieve(ps_integrator, "depth", int(1)),
+        retrieve(ps_integrator, "wavefront", false),
+        retrieve(ps_integrator, "shadow_cutoff", real_type(0)),
+        retrieve(ps_integrator, "light_selection", light_selection_t::all),
+        retrieve(ps_integrator, "light_samples", int(1)),
+        retrieve(ps_integrator, "min_throughput", real_type(0)),
+        retrieve(ps_integrator, "rr_depth", int(0))
     );
 }
 
 
-}
\ No newline at end of file
+}
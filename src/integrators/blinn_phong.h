@@ -5,16 +5,81 @@
 
 namespace rt3{
 
+class BlinnPhongMaterial;
+struct RayQueue;
+
 class BlinnPhongIntegrator : public SamplerIntegrator {
+public:
+    /// What one hit along a path contributes: its own (direct) light, and the weight of what it reflects.
+    struct PathVertex{
+        Color local, mirror;
+    };
+
 private:
     const int maxRecursionSteps;
+    const bool wavefront; //!< Trace a whole tile one bounce at a time instead of one path at a time.
+    const real_type shadowCutoff; //!< Lights contributing at most this much (per channel) get no shadow ray.
+    const light_selection_t lightSelection;
+    const int lightSamples;       //!< Lights drawn from the light tree per shading point (stochastic selection).
+    const real_type minThroughput; //!< Paths whose mirror throughput falls below this stop bouncing.
+    const int rouletteDepth;      //!< Bounce from which Russian roulette may end a path (0: never).
+
+    /// Whether the path goes on after bounce `depth`, updating its throughput with `mirror`
+    /// (which gets reweighted when Russian roulette, drawing from `rng`, lets the path survive).
+    bool continue_path(int depth, Color &throughput, Color &mirror, RandomStream &rng) const;
+    /*!
+     * Radiance of a path, folded back to front from its vertices. It is not clamped, so a
+     * mirror weight boosted by Russian roulette keeps all of its share of the pixel average.
+     * `ended` tells whether the path ended by escaping (or hitting a back face) with radiance
+     * `tail`, rather than by stopping to bounce.
+     */
+    static Color fold_path(const vector<PathVertex> &vertices, bool ended, const Color &tail);
+
+    /// What one light adds at a hit, if visible.
+    struct LightSample{
+        Color diffuse, specular;
+        int query = -1; //!< Shadow ray deciding the visibility (-1: always visible, e.g. ambient).
+    };
+
+    /// Diffuse and specular terms of one light.
+    void light_terms(const Ray&, const shared_ptr<ObjSurfel>&, const BlinnPhongMaterial&,
+        const Color &lightColor, const Vector3f &lightDir, Color &diffuse, Color &specular) const;
+    /// Appends light `l`, with its contribution scaled by `weight`, unless it cannot contribute.
+    void sample_light(int l, real_type weight, const Ray&, const shared_ptr<ObjSurfel>&, const BlinnPhongMaterial&,
+        const unique_ptr<Scene>&, vector<LightSample> &samples, vector<ShadowQuery> &queries) const;
+    /// Evaluates the selected lights at a hit before any shadow ray: lights that cannot contribute
+    /// (behind the surface, outside a spot cone, below the cutoff) are dropped, the others
+    /// are appended to `samples`, with their shadow ray appended to `queries`.
+    /// Stochastic selection draws its lights from `rng`.
+    void sample_lights(const Ray&, const shared_ptr<ObjSurfel>&, const BlinnPhongMaterial&, const unique_ptr<Scene>&,
+        RandomStream &rng, vector<LightSample> &samples, vector<ShadowQuery> &queries) const;
+    /// Adds up the visible samples, in scene light order.
+    Color gather_lights(const LightSample *first, const LightSample *last, const vector<ShadowQuery> &queries) const;
+
+    Ray reflected_ray(const Ray&, const shared_ptr<ObjSurfel>&) const;
+    /// Local (ambient + direct) term at a hit; the shadow rays of all lights are traced as one batch.
+    Color direct_light(const Ray&, const shared_ptr<ObjSurfel>&, const BlinnPhongMaterial&, const unique_ptr<Scene>&, RandomStream&) const;
+
+    void render_tile_wavefront(const unique_ptr<Scene>&, TileAccumulator &pixels) const;
+    /// A camera sample followed through its bounces by the wavefront mode.
+    struct Path;
+    /// Runs every bounce of the paths whose primary rays are in `queue`, breadth-first.
+    void trace_paths(const unique_ptr<Scene>&, vector<Path> &paths, RayQueue &queue) const;
+
 public:
     ~BlinnPhongIntegrator(){};
-    BlinnPhongIntegrator( unique_ptr<Camera> &&_camera, int depth ):
-        SamplerIntegrator(std::move(_camera)), maxRecursionSteps(depth){}
+    BlinnPhongIntegrator( unique_ptr<Camera> &&_camera, int depth, bool wavefront_mode = false, real_type shadow_cutoff = 0,
+        light_selection_t selection = light_selection_t::all, int light_samples = 1,
+        real_type min_throughput = 0, int rr_depth = 0 ):
+        SamplerIntegrator(std::move(_camera)), maxRecursionSteps(depth), wavefront(wavefront_mode), shadowCutoff(shadow_cutoff),
+        lightSelection(selection), lightSamples(std::max(1, light_samples)),
+        minThroughput(min_throughput), rouletteDepth(rr_depth){}
+
+    /// Follows the mirror bounces from the first hit iteratively, up to `depth` hits.
+    Color shade(const Ray&, const shared_ptr<ObjSurfel>&, const unique_ptr<Scene>&, const Color, RandomStream &rng) const override;
 
-    Color Li(const Ray&, const unique_ptr<Scene>&, const Color) const override;
-    Color recursiveLi(const Ray&, const unique_ptr<Scene>&, const Color, int currRecurStep) const;
+protected:
+    void render_tile(const unique_ptr<Scene>&, TileAccumulator &pixels) const override;
 };
 
 
@@ -24,4 +89,4 @@ BlinnPhongIntegrator* create_blinn_phong_integrator(const ParamSet &, unique_ptr
 };
 
 
-#endif 
\ No newline at end of file
+#endif 
@@ -1,17 +1,16 @@
 #include "depth_map.h"
+#include "../core/parallel.h"
+#include "../core/ray_packet.h"
+
+#include <limits>
 
 namespace rt3{
 
-Color DepthMapIntegrator::Li(const Ray& ray, const unique_ptr<Scene>& scene, const Color backgroundColor) const{
-    
-    shared_ptr<ObjSurfel> isect; // Intersection information.  
-    if (!scene->intersect(ray, isect)) {
+Color DepthMapIntegrator::shade(const Ray& ray, const shared_ptr<ObjSurfel>& isect, const unique_ptr<Scene>& scene, const Color backgroundColor, RandomStream &rng) const{
+    if (isect == nullptr) {
         return far_color;
     }else{
-        real_type norm_t = normalizeT(isect->t);
-        real_type norm_z = normalizeZ(norm_t);
-
-        return Color::interpolate_color(norm_z, near_color, far_color).clamp();
+        return depth_color(normalizeZ(normalizeT(isect->t)));
     }
 }
 
@@ -23,28 +22,137 @@ inline real_type DepthMapIntegrator::normalizeT(real_type x) const{
     return (x - scene_tmin) / t_range;
 }
 
-void DepthMapIntegrator::preprocess(const unique_ptr<Scene> &scene){
-    auto w = camera->film->width(); // Retrieve the image dimensions in pixels.
-    auto h = camera->film->height();
+Color DepthMapIntegrator::depth_color(real_type weight) const{
+    if(std::isnan(weight)) return far_color;
+    return Color::interpolate_color(weight, near_color, far_color).clamp();
+}
+
+void DepthMapIntegrator::trace_depths(const unique_ptr<Scene> &scene, bool keep){
+    const int w = camera->film->width(); // The whole image: a crop window is colored as in the full image.
+    const int h = camera->film->height();
+    const int spp = sampler->samples_per_pixel();
+    sampleWeights.assign(keep ? size_t(w) * h * spp : 0, real_type(INF));
+
+    // The range is that of the first sample of every pixel, so it does not depend on how many
+    // samples are traced. Every tile reduces its own; they are merged once all tiles are traced.
+    const int traced = keep ? spp : 1;
+    const int nTilesX = (w + TILE_SIZE - 1) / TILE_SIZE;
+    const int nTiles = nTilesX * ((h + TILE_SIZE - 1) / TILE_SIZE);
+    vector<real_type> tileMin(nTiles, INFINITY), tileMax(nTiles, 0);
+
+    parallel_for(nTiles, n_threads, [&](int tile, int /* worker */){
+        const int i0 = (tile / nTilesX) * TILE_SIZE, i1 = min(i0 + TILE_SIZE, h);
+        const int j0 = (tile % nTilesX) * TILE_SIZE, j1 = min(j0 + TILE_SIZE, w);
+        thread_local vector<Point2f> offsets;
+        sampler->tile_samples(i0, i1, j0, j1, spp, offsets);
+        const int tileWidth = j1 - j0;
 
-    for ( int i = 0 ; i < h; i++ ) {
-        for( int j = 0 ; j < w ; j++ ) {        
-            Ray ray = camera->generate_ray( i, j );
+        real_type tmin = INFINITY, tmax = 0;
+        auto hit = [&](int i, int j, int s, real_type t){
+            if(keep) sampleWeights[(size_t(i) * w + j) * spp + s] = t;
+            if(s > 0) return;
+            tmin = min(tmin, t);
+            tmax = max(tmax, t);
+        };
 
-            shared_ptr<ObjSurfel> isect; // Intersection information.  
-            if (scene->intersect(ray, isect)) {
-                scene_tmin = min(scene_tmin, isect->t);
-                scene_tmax = max(scene_tmax, isect->t);
+        if(use_packets){
+            // Only the distances are needed: no hit record is built.
+            RayPacket packet;
+            for ( int pi = i0 ; pi < i1; pi += RayPacket::WIDTH ) {
+                for( int pj = j0 ; pj < j1 ; pj += RayPacket::WIDTH ) {
+                    for( int s = 0; s < traced; s++ ) {
+                        packet.clear();
+                        for ( int i = pi ; i < min(pi + RayPacket::WIDTH, i1); i++ ) {
+                            for( int j = pj ; j < min(pj + RayPacket::WIDTH, j1) ; j++ ) {
+                                const Point2f &offset = offsets[(size_t(i - i0) * tileWidth + (j - j0)) * spp + s];
+                                packet.add(camera->generate_ray( film_position(i, j, offset) ), i, j);
+                            }
+                        }
+                        packet.finalize();
+                        scene->intersect_packet(packet);
+                        for(int k = 0; k < packet.count; ++k){
+                            if(packet.hit[k] != nullptr) hit(packet.row[k], packet.col[k], s, packet.tHit[k]);
+                        }
+                    }
+                }
+            }
+        }else{
+            const Point2f *offset = offsets.data();
+            for ( int i = i0 ; i < i1; i++ ) {
+                for( int j = j0 ; j < j1 ; j++, offset += spp ) {
+                    for( int s = 0; s < traced; s++ ) {
+                        Ray ray = camera->generate_ray( film_position(i, j, offset[s]) );
+                        shared_ptr<ObjSurfel> isect; // Intersection information.
+                        if (scene->intersect(ray, isect)) hit(i, j, s, isect->t);
+                    }
+                }
             }
         }
-    }
+        tileMin[tile] = tmin;
+        tileMax[tile] = tmax;
+    });
 
+    scene_tmin = INFINITY;
+    scene_tmax = 0;
+    for(int tile = 0; tile < nTiles; ++tile){
+        scene_tmin = min(scene_tmin, tileMin[tile]);
+        scene_tmax = max(scene_tmax, tileMax[tile]);
+    }
     t_range = scene_tmax - scene_tmin;
+    if(!keep) return;
+
+    // Distances to color weights, a branch-free pass over each row of samples.
+    const real_type nan = std::numeric_limits<real_type>::quiet_NaN();
+    const size_t rowSize = size_t(w) * spp;
+    parallel_for(h, n_threads, [&](int i, int /* worker */){
+        real_type *row = sampleWeights.data() + size_t(i) * rowSize;
+        for(size_t k = 0; k < rowSize; ++k){
+            row[k] = row[k] < real_type(INF) ? normalizeZ(normalizeT(row[k])) : nan;
+        }
+    });
+}
+
+void DepthMapIntegrator::render_tile(const unique_ptr<Scene> &scene, TileAccumulator &pixels) const{
+    if(sampleWeights.empty()){
+        SamplerIntegrator::render_tile(scene, pixels);
+        return;
+    }
+
+    const int i0 = pixels.i0, i1 = pixels.i1, j0 = pixels.j0, j1 = pixels.j1;
+    const int n = pixels.sample_limit();
+    const int spp = sampler->samples_per_pixel();
+    const int w = camera->film->width();
+    thread_local vector<Point2f> offsets;
+    sampler->tile_samples(i0, i1, j0, j1, n, offsets);
+
+    const Point2f *offset = offsets.data();
+    for ( int i = i0 ; i < i1; i++ ) {
+        for( int j = j0 ; j < j1 ; j++, offset += n ) {
+            const real_type *weights = sampleWeights.data() + (size_t(i) * w + j) * spp;
+            for( int s = pixels.count(i, j); pixels.needs_samples(i, j); s++ ) {
+                pixels.add( i, j, offset[s], depth_color(weights[s]) );
+            }
+        }
+    }
 }
 
 void DepthMapIntegrator::render(const unique_ptr<Scene>& sc){
-    preprocess(sc);
+    // The tiles are shaded from the kept samples only when they all reach the film at the end
+    // of a single pass, and all of them are taken. Otherwise (and with AOVs, which need the full
+    // hits) the range comes from a pass of its own, and the tiles trace their rays.
+    const auto &film = camera->film;
+    const bool keep = !film->is_streaming() && !film->has_aovs() && workers.empty() && !progressive
+                   && adaptive_threshold <= 0
+                   && checkpoint_interval_s <= 0 && !resume_render
+                   && size_t(film->width()) * film->height() * sampler->samples_per_pixel() <= MAX_KEPT_SAMPLES;
+    trace_depths(sc, keep);
     SamplerIntegrator::render(sc);
+    sampleWeights = vector<real_type>();
+}
+
+void DepthMapIntegrator::serve(const unique_ptr<Scene>& sc, Connection &coordinator){
+    trace_depths(sc, false);
+    SamplerIntegrator::serve(sc, coordinator);
 }
 
 DepthMapIntegrator* create_depth_map_integrator(const ParamSet &ps_integrator, unique_ptr<Camera> &&camera){
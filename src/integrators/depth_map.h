@@ -5,16 +5,32 @@
 
 namespace rt3{
 
+/*!
+ * Colors each pixel by the distance to its first hit, from `near_color` at the
+ * closest hit of the frame to `far_color` at the farthest (rescaled by [zmin, zmax]).
+ * That range is only known once the whole frame is traced, so the first hit of
+ * every sample is kept, and the tiles are shaded from those distances afterwards.
+ * The range is that of the first sample of every pixel.
+ */
 class DepthMapIntegrator : public SamplerIntegrator {
 private:
     real_type zmin, zmax, z_range;
     Color near_color, far_color;
 
     real_type scene_tmin, scene_tmax, t_range;
-    void preprocess(const unique_ptr<Scene>&);
+    /// Weight between the near and the far color of every sample of the image (NaN: missed),
+    /// pixel by pixel, `spp` samples each. Empty when the tiles trace their rays themselves.
+    vector<real_type> sampleWeights;
+    /// Most samples kept in sampleWeights; larger renders trace their rays twice.
+    static const size_t MAX_KEPT_SAMPLES = size_t(1) << 28;
+
+    /// Traces the first sample of every pixel of the image in parallel, and reduces the range of
+    /// distances of their hits. With `keep`, traces every sample and fills sampleWeights.
+    void trace_depths(const unique_ptr<Scene>&, bool keep);
 
     real_type normalizeZ(real_type x) const;
     real_type normalizeT(real_type x) const;
+    Color depth_color(real_type weight) const;
 
 public:
     ~DepthMapIntegrator(){};
@@ -30,8 +46,13 @@ public:
         z_range = z_max - z_min;
     }
 
-    Color Li(const Ray&, const unique_ptr<Scene>&, const Color) const override;
+    Color shade(const Ray&, const shared_ptr<ObjSurfel>&, const unique_ptr<Scene>&, const Color, RandomStream&) const override;
     void render( const unique_ptr<Scene>& ) override;
+    void serve( const unique_ptr<Scene>&, Connection &coordinator ) override;
+
+protected:
+    /// Shades the tile from sampleWeights, if it was filled; traces it otherwise.
+    void render_tile(const unique_ptr<Scene>&, TileAccumulator &pixels) const override;
 };
 
 
@@ -42,4 +63,4 @@ DepthMapIntegrator* create_depth_map_integrator(const ParamSet &, unique_ptr<Cam
 };
 
 
-#endif
\ No newline at end of file
+#endif
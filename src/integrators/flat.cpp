@@ -1,18 +1,16 @@
 #include "flat.h"
-#include "../materials/flat.h"
+#include "../materials/material_table.h"
 
 namespace rt3{
 
-Color FlatIntegrator::Li(const Ray& ray, const unique_ptr<Scene>& scene, const Color backgroundColor) const{
-    
-    shared_ptr<ObjSurfel> isect; // Intersection information.  
-    if (!scene->intersect(ray, isect)) {
+Color FlatIntegrator::shade(const Ray& ray, const shared_ptr<ObjSurfel>& isect, const unique_ptr<Scene>& scene, const Color backgroundColor, RandomStream &rng) const{
+    if (isect == nullptr) {
         return backgroundColor;
     }else{
         // Some form of determining the incoming radiance at the ray's origin.
         // For this integrator, it might just be:
-        // Polymorphism in action.
-        shared_ptr<FlatMaterial> fm = std::dynamic_pointer_cast<FlatMaterial>( isect->primitive->get_material() );
+        // The material is looked up by index in the scene's table.
+        const FlatMaterial *fm = scene->materials->get<FlatMaterial>( isect->primitive->materialId );
         // Assign diffuse color to L.
         return fm->getColor(); // Call a method present only in FlatMaterial.
     }
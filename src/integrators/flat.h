@@ -13,7 +13,7 @@ public:
     FlatIntegrator( unique_ptr<Camera> &&_camera ):
         SamplerIntegrator(std::move(_camera)){}
 
-    Color Li(const Ray&, const unique_ptr<Scene>&, const Color) const override;
+    Color shade(const Ray&, const shared_ptr<ObjSurfel>&, const unique_ptr<Scene>&, const Color, RandomStream&) const override;
 };
 
 
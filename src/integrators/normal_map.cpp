@@ -12,10 +12,8 @@ Color NormalIntegrator::getColorFromNormal(const Vector3f &n) const{
     }).clamp();
 }
 
-Color NormalIntegrator::Li(const Ray& ray, const unique_ptr<Scene>& scene, const Color backgroundColor) const{
-    
-    shared_ptr<ObjSurfel> isect; // Intersection information.  
-    if (!scene->intersect(ray, isect)) {
+Color NormalIntegrator::shade(const Ray& ray, const shared_ptr<ObjSurfel>& isect, const unique_ptr<Scene>& scene, const Color backgroundColor, RandomStream &rng) const{
+    if (isect == nullptr) {
         return backgroundColor;
     }else{
         return getColorFromNormal(isect->n);      
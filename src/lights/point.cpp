@@ -21,6 +21,11 @@ tuple<Color, unique_ptr<VisibilityTester>, Vector3f> PointLight::Li(const shared
     };
 }
 
+bool PointLight::bounds( LightBounds &b ) const{
+    b = LightBounds{position, Vector3f({0, 0, 1}), real_type(M_PI)};
+    return true;
+}
+
 PointLight* create_point_light( const ParamSet &ps ){
     return new PointLight(
         retrieve(ps, "I", Color()),
@@ -14,6 +14,7 @@ public:
 
     
     tuple<Color, unique_ptr<VisibilityTester>, Vector3f> Li(const shared_ptr<Surfel>& hit) override;
+    bool bounds( LightBounds &b ) const override;
 
 };
 
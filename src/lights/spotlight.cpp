@@ -33,6 +33,11 @@ tuple<Color, unique_ptr<VisibilityTester>, Vector3f> SpotlightLight::Li(const sh
     };
 }
 
+bool SpotlightLight::bounds( LightBounds &b ) const{
+    b = LightBounds{position, lightDirection, Radians(cutoff)};
+    return true;
+}
+
 SpotlightLight* create_spotlight_light( const ParamSet &ps ){
     Point3f from = retrieve(ps, "from", Point3f());
     Point3f to = retrieve(ps, "to", Point3f());
@@ -21,8 +21,23 @@ void usage(const char *msg=nullptr )
     std::cerr << "Usage: rt3 [<options>] <input_scene_file>\n"
         << "  Rendering simulation options:\n"
         << "    --help                     Print this help text.\n"
-        << "    --cropwindow <x0,x1,y0,y1> Specify an image crop window.\n"
+        << "    --cropwindow <x0,x1,y0,y1> Render only this region of the image (fractions of the\n"
+        << "                               width and height, from the top left corner).\n"
         << "    --quick                    Reduces quality parameters to render image quickly.\n"
+        << "    --nthreads <n>             Number of render threads (default: all cores).\n"
+        << "    --progressive              Render in passes of increasing quality, writing the image\n"
+        << "                               as it improves.\n"
+        << "    --time-budget <seconds>    Stop at this deadline with the best image so far\n"
+        << "                               (implies --progressive).\n"
+        << "    --flush-interval <seconds> Time between partial images (default: 1).\n"
+        << "    --checkpoint <seconds>     Save the state of the render to <image file>.ckpt this\n"
+        << "                               often, so an interrupted render can be resumed.\n"
+        << "    --resume                   Continue the render saved in <image file>.ckpt.\n"
+        << "  Distributed rendering (every process loads the same scene file):\n"
+        << "    --spawn-workers <n>        Render the tiles on <n> worker processes started here.\n"
+        << "    --workers <host:port,...>  Render the tiles on workers already running there.\n"
+        << "    --worker <port>            Be a worker: wait for a coordinator on this port,\n"
+        << "                               render the tiles it asks for, then exit.\n"
         << "    --outfile <filename>       Write the rendered image to <filename>.\n\n";
     exit( msg ? 1 : 0 );
 }
@@ -32,6 +47,7 @@ void usage(const char *msg=nullptr )
 int main( int argc, char * argv[] )
 {
     RunningOptions opt; // Stores incoming arguments.
+    opt.program = argv[0];
 
     // ================================================
     // (1) Validate command line arguments.
@@ -60,6 +76,67 @@ int main( int argc, char * argv[] )
             // Get output image file name.
             opt.outfile = std::string{ argv[++i] };
         }
+        else if ( option == "--nthreads" or option == "-nthreads" or option == "-t" )
+        {
+            if ( i+1 == argc ) // The option's argument is missing.
+                usage( "missing value after --nthreads argument");
+            opt.nthreads = std::stoi( argv[++i] );
+        }
+        else if ( option == "--progressive" or option == "-progressive" )
+        {
+            opt.progressive = true;
+        }
+        else if ( option == "--time-budget" or option == "-time-budget" )
+        {
+            if ( i+1 == argc ) // The option's argument is missing.
+                usage( "missing value after --time-budget argument");
+            opt.time_budget = std::stof( argv[++i] );
+        }
+        else if ( option == "--flush-interval" or option == "-flush-interval" )
+        {
+            if ( i+1 == argc ) // The option's argument is missing.
+                usage( "missing value after --flush-interval argument");
+            opt.flush_interval = std::stof( argv[++i] );
+        }
+        else if ( option == "--checkpoint" or option == "-checkpoint" )
+        {
+            if ( i+1 == argc ) // The option's argument is missing.
+                usage( "missing value after --checkpoint argument");
+            opt.checkpoint_interval = std::stof( argv[++i] );
+        }
+        else if ( option == "--resume" or option == "-resume" )
+        {
+            opt.resume = true;
+        }
+        else if ( option == "--spawn-workers" or option == "-spawn-workers" )
+        {
+            if ( i+1 == argc ) // The option's argument is missing.
+                usage( "missing value after --spawn-workers argument");
+            opt.spawn_workers = std::stoi( argv[++i] );
+        }
+        else if ( option == "--workers" or option == "-workers" )
+        {
+            if ( i+1 == argc ) // The option's argument is missing.
+                usage( "missing value after --workers argument");
+            // Comma separated list of host:port.
+            std::istringstream list{ argv[++i] };
+            std::string address;
+            while ( std::getline( list, address, ',' ) )
+                if ( !address.empty() ) opt.workers.push_back( address );
+        }
+        else if ( option == "--worker" or option == "-worker" )
+        {
+            if ( i+1 == argc ) // The option's argument is missing.
+                usage( "missing value after --worker argument");
+            opt.worker_port = std::stoi( argv[++i] );
+        }
+        else if ( option == "--worker-fd" )
+        {
+            // Internal: set by --spawn-workers on the processes it starts.
+            if ( i+1 == argc ) // The option's argument is missing.
+                usage( "missing value after --worker-fd argument");
+            opt.worker_fd = std::stoi( argv[++i] );
+        }
         else if ( option == "--quickrender" or option == "-quickrender" or option == "-q" or option == "--quick" or option == "-quick")
         {
             opt.quick_render = true;
@@ -0,0 +1,30 @@
+#include "material_table.h"
+
+namespace rt3{
+
+int MaterialTable::add(const shared_ptr<Material> &material){
+    if(material == nullptr) return -1;
+
+    auto found = ids.find(material.get());
+    if(found != ids.end()) return found->second;
+
+    if(auto flat = dynamic_cast<const FlatMaterial*>(material.get())){
+        records.emplace_back(*flat);
+    }else if(auto phong = dynamic_cast<const BlinnPhongMaterial*>(material.get())){
+        records.emplace_back(*phong);
+    }else{
+        RT3_ERROR("Unknown material type in the material table.");
+    }
+
+    int id = int(records.size()) - 1;
+    ids[material.get()] = id;
+    return id;
+}
+
+Color MaterialTable::albedo(int id) const{
+    if(id < 0) return Color();
+    if(auto flat = std::get_if<FlatMaterial>(&records[id])) return flat->color;
+    return std::get<BlinnPhongMaterial>(records[id]).diffuse;
+}
+
+}
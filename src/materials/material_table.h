@@ -0,0 +1,45 @@
+#ifndef MATERIAL_TABLE_H
+#define MATERIAL_TABLE_H
+
+#include <variant>
+
+#include "flat.h"
+#include "blinn_phong.h"
+
+namespace rt3{
+
+/// Every concrete material, stored by value.
+using MaterialRecord = std::variant<FlatMaterial, BlinnPhongMaterial>;
+
+/*!
+ * The materials of a scene in one flat array. Each primitive only keeps the
+ * index of its material, so resolving it while shading is a load and a check
+ * of the variant tag, instead of a refcounted cast.
+ */
+class MaterialTable{
+private:
+    vector<MaterialRecord> records;
+    map<const Material*, int> ids; //!< Materials already in the table (a material is shared by many primitives).
+
+public:
+    /// Index of `material` in the table, adding it if needed; -1 for no material.
+    int add(const shared_ptr<Material> &material);
+
+    /// The material `id` if it has type M, nullptr otherwise (or if `id` is -1).
+    template<typename M>
+    const M * get(int id) const{
+        if(id < 0) return nullptr;
+        return std::get_if<M>(&records[id]);
+    }
+
+    /// Diffuse reflectance of material `id` (black for -1).
+    Color albedo(int id) const;
+
+    const MaterialRecord & operator[](int id) const{ return records[id]; }
+    size_t size() const{ return records.size(); }
+};
+
+}
+
+
+#endif
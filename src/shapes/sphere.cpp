@@ -6,8 +6,10 @@ real_type Sphere::bhaskara(const Ray &r, real_type &A, real_type &B) const{
     Vector3f centerToOrigin = (r.o - origin);
     A = r.d * r.d;
     B = 2 * (centerToOrigin * r.d);
-    real_type C = (centerToOrigin * centerToOrigin) - (radius * radius);
-    real_type delta = (B * B) - (4 * A * C);
+    // B^2 - 4AC, written with the ray's closest approach to the center: it does not
+    // cancel two large numbers when the origin is far away (a shadow ray, a big scene).
+    Vector3f closest = centerToOrigin + r.d * (-(centerToOrigin * r.d) / A);
+    real_type delta = 4 * A * ((radius * radius) - (closest * closest));
 
     return delta;
 }
@@ -18,9 +20,11 @@ bool Sphere::getT(const Ray &r, real_type &t) const{
     real_type A, B;
     real_type delta = bhaskara(r, A, B);
     if(delta >= -0.0001){
+        // Grazing rays are accepted with a small negative delta; treat it as a tangent.
+        real_type sqrtDelta = sqrt(max(delta, real_type(0)));
         real_type roots[2] = {
-            (-B - sqrt(delta)) / (2 * A),
-            (-B + sqrt(delta)) / (2 * A),
+            (-B - sqrtDelta) / (2 * A),
+            (-B + sqrtDelta) / (2 * A),
         };
         if(roots[0] > roots[1]) swap(roots[0], roots[1]);
         if(roots[0] < 0){
@@ -37,19 +41,41 @@ bool Sphere::getT(const Ray &r, real_type &t) const{
 }
 
 
-bool Sphere::intersect_p(const Ray &r, real_type maxT) const{
+bool Sphere::getWorldT(const Ray &r, real_type &t) const{
     auto invRay = inv_transform->apply(r);
-    real_type t;
     if(!getT(invRay, t)) return false;
 
 		Point3f contact = invRay(t);
 		contact = transform->apply(contact);
 		t = (contact - r.o).getNorm();
 
+    return true;
+}
+
+
+bool Sphere::intersect_p(const Ray &r, real_type maxT) const{
+    real_type t;
+    if(!getWorldT(r, t)) return false;
+
     return t < maxT;
 }
 
 
+void Sphere::intersect_packet(RayPacket &packet, const GeometricPrimitive *owner) const{
+    // Spheres are instanced through a transform, so each ray is tested on its own,
+    // but without building a hit record.
+    for(int k = 0; k < packet.count; ++k){
+        if(!packet.active[k]) continue;
+
+        real_type t;
+        if(getWorldT(packet.rays[k], t) && t < packet.tHit[k]){
+            packet.tHit[k] = t;
+            packet.hit[k] = owner;
+        }
+    }
+}
+
+
 bool Sphere::intersect(const Ray &r, shared_ptr<ObjSurfel> &isect) const{
     auto invRay = inv_transform->apply(r);
 
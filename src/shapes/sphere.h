@@ -10,6 +10,8 @@ class Sphere : public Shape{
 private:
     real_type bhaskara(const Ray &r, real_type &A, real_type &B) const;
     bool getT(const Ray &r, real_type &t) const;
+    /// Distance, in world space, from the origin of `r` to the sphere.
+    bool getWorldT(const Ray &r, real_type &t) const;
 public:
     bool flip_normals;
     Point3f origin;
@@ -27,6 +29,7 @@ public:
     Bounds3f computeBounds() const override;
     bool intersect_p(const Ray &r, real_type maxT) const override;
     bool intersect(const Ray &r, shared_ptr<ObjSurfel> &isect) const override;
+    void intersect_packet(RayPacket &packet, const GeometricPrimitive *owner) const override;
 };
 
 
@@ -9,7 +9,7 @@ bool Triangle::_intersect(const Ray &r, real_type &t, real_type &u, real_type &v
 	Vector3f h = r.d.cross(edge[1]);
 	
 	auto a = edge[0] * h;
-	if(abs(a) < EPS) return false; // This ray is parallel to this triangle.
+	if(std::abs(a) < minDeterminant) return false; // This ray is parallel to this triangle.
 	
 	real_type f = 1 / a;
 	Vector3f s = r.o - *vert[0];
@@ -52,6 +52,55 @@ bool Triangle::intersect(const Ray &r, shared_ptr<ObjSurfel> &isect) const{
 	return true;
 }
 
+void Triangle::intersect_packet(RayPacket &packet, const GeometricPrimitive *owner) const{
+	Vector3f edge[2] = {*vert[1] - *vert[0], *vert[2] - *vert[0]};
+
+	const real_type e0x = edge[0].at(0), e0y = edge[0].at(1), e0z = edge[0].at(2);
+	const real_type e1x = edge[1].at(0), e1y = edge[1].at(1), e1z = edge[1].at(2);
+	const real_type v0x = vert[0]->at(0), v0y = vert[0]->at(1), v0z = vert[0]->at(2);
+
+	const bool cull = mesh->backface_cull;
+	const Normal3f &n0 = *n[0], &n1 = *n[1], &n2 = *n[2];
+
+	for(int k = 0; k < RayPacket::SIZE; ++k){
+		const real_type dx = packet.dx[k], dy = packet.dy[k], dz = packet.dz[k];
+
+		// h = d x edge1
+		real_type hx = dy * e1z - dz * e1y;
+		real_type hy = dz * e1x - dx * e1z;
+		real_type hz = dx * e1y - dy * e1x;
+
+		real_type a = e0x * hx + e0y * hy + e0z * hz;
+		real_type f = 1 / a;
+
+		real_type sx = packet.ox[k] - v0x, sy = packet.oy[k] - v0y, sz = packet.oz[k] - v0z;
+		real_type u = f * (sx * hx + sy * hy + sz * hz);
+
+		// q = s x edge0
+		real_type qx = sy * e0z - sz * e0y;
+		real_type qy = sz * e0x - sx * e0z;
+		real_type qz = sx * e0y - sy * e0x;
+
+		real_type v = f * (dx * qx + dy * qy + dz * qz);
+		real_type t = f * (e1x * qx + e1y * qy + e1z * qz);
+
+		bool isHit = packet.active[k] && std::fabs(a) >= minDeterminant &&
+			u >= 0 && u <= 1 && v >= 0 && u + v <= 1 &&
+			t >= EPS && t < packet.tHit[k];
+
+		if(cull){
+			real_type w = 1 - u - v;
+			real_type nx = n1.at(0) * u + n2.at(0) * v + n0.at(0) * w;
+			real_type ny = n1.at(1) * u + n2.at(1) * v + n0.at(1) * w;
+			real_type nz = n1.at(2) * u + n2.at(2) * v + n0.at(2) * w;
+			isHit = isHit && (nx * dx + ny * dy + nz * dz) <= 0;
+		}
+
+		packet.tHit[k] = isHit ? t : packet.tHit[k];
+		packet.hit[k] = isHit ? owner : packet.hit[k];
+	}
+}
+
 Bounds3f Triangle::computeBounds() const{
 	return Bounds3f::createBox({*vert[0], *vert[1], *vert[2]});
 }
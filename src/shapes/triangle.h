@@ -13,6 +13,9 @@ private:
   shared_ptr<const Normal3f> n[3];
 
   shared_ptr<TriangleMesh> mesh; //!< This is the **indexed triangle mesh database** this triangle is linked to.
+  /// Smallest |determinant| of a ray the triangle is not parallel to: EPS times the length of
+  /// both edges, so the test is on the angle of the ray whatever the size of the triangle.
+  real_type minDeterminant;
 
 
 
@@ -34,6 +37,7 @@ public:
       vert[i] = vertices[v_indexes[ 3 * tri_id + i]];
       n[i] = normals[n_indexes[ 3 * tri_id + i]];
     }
+    minDeterminant = EPS * (*vert[1] - *vert[0]).getNorm() * (*vert[2] - *vert[0]).getNorm();
 
   }
 
@@ -45,6 +49,8 @@ public:
 
   bool intersect_p(const Ray &r, real_type maxT) const override;
   bool intersect(const Ray &r, shared_ptr<ObjSurfel> &isect) const override;
+  /// Moller-Trumbore over all the rays of the packet at once (same arithmetic as _intersect()).
+  void intersect_packet(RayPacket &packet, const GeometricPrimitive *owner) const override;
 
   /// This friend function helps us debug the triangles, if we want to.
   friend std::ostream& operator<<( std::ostream& os, const Triangle & t );